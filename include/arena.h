@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace utils
+{
+	// memory of one job, handed out by bumping a pointer and given back in one step by
+	// reset. the buffer is kept for the next job and grows to hold the largest job
+	// seen, so a recycled arena stops touching the heap once it has seen its workload
+	struct Arena : std::pmr::memory_resource
+	{
+		static constexpr size_t INITIAL_CAPACITY = 1 << 16;
+
+		// heap blocks the current job needed past the buffer
+		struct Overflow : std::pmr::memory_resource
+		{
+			size_t bytes = 0;
+
+			void* do_allocate(size_t size, size_t alignment) override
+			{
+				bytes += size;
+				return std::pmr::new_delete_resource()->allocate(size, alignment);
+			}
+
+			void do_deallocate(void* memory, size_t size, size_t alignment) override
+			{
+				std::pmr::new_delete_resource()->deallocate(memory, size, alignment);
+			}
+
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+			{
+				return this == &other;
+			}
+		};
+
+		std::unique_ptr<std::byte[]> buffer;
+		size_t capacity = 0;
+		Overflow overflow;
+		std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+		Arena()
+		{
+			reset();
+		}
+
+		Arena(const Arena&) = delete;
+		Arena& operator = (const Arena&) = delete;
+
+		// everything allocated from the arena is gone, containers using it have to be
+		// emptied with release first
+		void reset()
+		{
+			resource.reset();
+			if (buffer == nullptr || overflow.bytes != 0)
+			{
+				capacity = std::max(INITIAL_CAPACITY, capacity + overflow.bytes);
+				buffer.reset(new std::byte[capacity]);
+				overflow.bytes = 0;
+			}
+			resource.emplace(buffer.get(), capacity, &overflow);
+		}
+
+	private:
+		void* do_allocate(size_t size, size_t alignment) override
+		{
+			return resource->allocate(size, alignment);
+		}
+
+		// freed by reset
+		void do_deallocate(void*, size_t, size_t) override
+		{
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+	};
+
+	// gives the memory of a container back before its arena is reset, the container
+	// keeps allocating from the same resource
+	template <typename Container>
+	void release(Container& container)
+	{
+		Container(container.get_allocator()).swap(container);
+	}
+}
@@ -1,513 +1,235 @@
 #pragma once
 
-#include <fstream>
-#include <unordered_map>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "utils.h"
+#include "arena.h"
+#include "diagnostics.h"
+#include "stats.h"
 #include "tokenizer.h"
+#include "sourcebuffer.h"
+#include "cache.h"
+#include "config.h"
+#include "passes.h"
+#include "parallel.h"
+#include "onepass.h"
+#include "include.h"
+#include "optimizer.h"
+#include "flowgraph.h"
 
 namespace assembler
 {
-	const std::string INTERMEDIATE_PATH = "intermediate.ime";
-	const std::string SYMBOLTABLE_PATH = "symbolTable.sym";
-	const std::string OBJECT_PATH = "output.out";
-
-	enum class OperandType
-	{
-		OT_ADDRESS,
-		OT_LITERAL,
-		OT_NONE,
-	};
-	
-	struct Label
+	// everything besides the source that changes the image : assembler version and instruction set
+	uint64_t cacheSeed()
 	{
-		tokenizer::Token token;
-		OperandType labelType;
-		int labelValue;
-
-		friend std::ofstream& operator << (std::ofstream& os, const Label& lb)
+		static const uint64_t seed = []()
 		{
-			os << lb.token.value;
-			os << '|';
-			switch (lb.labelType)
+			std::string description = ASSEMBLER_VERSION;
+			for (auto& operation : OperationTable)
 			{
-			case OperandType::OT_ADDRESS:
-				os << 0;
-				break;
-			case OperandType::OT_LITERAL:
-				os << 1;
-				break;
+				description += '|' + std::string(operation.mnemonic) + ',' + std::to_string(operation.opcode) + ',' + std::to_string(operation.wordSize) + ',' + std::to_string(static_cast<int>(operation.operandType)) + ',' + std::to_string(operation.cycles);
 			}
-			os << lb.labelValue;
-			os << '\n';
 
-			return os;
-		}
-
-		friend std::ifstream& operator >> (std::ifstream& is, Label& lb)
-		{
-			char c;
-			std::string value;
+			return cache::hash64(description);
+		}();
 
-			//get token
-			std::string tokenValue;
-			while (is >> c && c != '|')
-			{
-				tokenValue.push_back(c);
-			}
-			
-			//get label type
-			is >> c;
-			OperandType labelType = (c == '0') ? OperandType::OT_ADDRESS : OperandType::OT_LITERAL;
-
-			//get label value
-			while (is.get(c) && c != '\n')
-			{
-				value.push_back(c);
-			}
-			int labelValue = stoi(value);
-
-			lb = { {tokenizer::TokenType::TK_SYMBOL, tokenValue}, labelType, labelValue };
-			return is;
-		}
-	};
+		return seed;
+	}
 
-	struct Operation
+	// buffers of one job, long running callers keep them warm between jobs
+	struct Workspace
 	{
-		std::string mnemonic;
-		unsigned char opcode;
-		unsigned int wordSize;
-		OperandType operandType;
+		// tokens and records of the job, declared first to outlive their containers
+		utils::Arena arena;
+		tokenizer::TokenStream tokens{ &arena };
+		Intermediate intermediate{ &arena };
+		FlowGraph flowGraph;
+		Peephole peephole;
+		// what -O did to the last job
+		OptimizationReport optimization;
+
+		// frees the last job in one step, the arena keeps its memory for the next
+		void reset()
+		{
+			tokens.release();
+			intermediate.release();
+			arena.reset();
+		}
 	};
 
-	std::unordered_map<std::string, Operation> OpCodeTable =
+	// errors go to diagnostics and the job keeps going past them, returns false if
+	// there were any. the image is incomplete then and not cached
+	bool assembleSource(std::string_view source, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, Workspace& workspace, const Options& options = {})
 	{
-		{"HLT", {"HLT", 0x00, 1, OperandType::OT_NONE}},
-		{"LDA", {"LDA", 0x10, 3, OperandType::OT_ADDRESS}},
-		{"LDI", {"LDI", 0x11, 2, OperandType::OT_LITERAL}},
-		{"ADD", {"ADD", 0x20, 3, OperandType::OT_ADDRESS}},
-		{"ADI", {"ADI", 0x21, 2, OperandType::OT_LITERAL}},
-		{"SUB", {"SUB", 0x25, 3, OperandType::OT_ADDRESS}},
-		{"SUI", {"SUI", 0x26, 2, OperandType::OT_LITERAL}},
-		{"STA", {"STA", 0x40, 3, OperandType::OT_ADDRESS}},
-		{"JMP", {"JMP", 0x50, 3, OperandType::OT_ADDRESS}},
-		{"JC",  {"JC",  0x51, 3, OperandType::OT_ADDRESS}},
-		{"JZ",  {"JZ",  0x52, 3, OperandType::OT_ADDRESS}},
-		{"PRT", {"PRT", 0xE0, 1, OperandType::OT_NONE}},
-		{"NOP", {"NOP", 0xFF, 1, OperandType::OT_NONE}},
-	};
+		tokenizer::TokenStream& tokens = workspace.tokens;
+		Intermediate& intermediate = workspace.intermediate;
 
+		workspace.reset();
 
-	enum class RecordType
-	{
-		RT_DEF_ADDRESS,
-		RT_DEF_LITERAL,
-		RT_DEF_LABEL,
-
-		RT_INS_ADDRESS,
-		RT_INS_LITERAL,
-		RT_INS_LABEL,
-		RT_INS_NONE
-	};
+		// the image is appended to output, whatever output held before is not cached
+		size_t imageStart = output.size();
 
-	struct Record
-	{
-		RecordType type;
-		tokenizer::TokenGroup tokenGroup;
+		// an image built from includes depends on more than the source
+		cache::Cache* imageCache = mayInclude(source) ? nullptr : options.cache;
 
-		friend std::ofstream& operator << (std::ofstream& os, const Record& rd)
+		uint64_t cacheKey = 0;
+		if (imageCache != nullptr)
 		{
-			switch (rd.type)
+			std::string symbolTableBytes;
+
+			// optimized images are cached apart from plain ones
+			cacheKey = cache::hash64(source, options.optimize ? cache::hash64("optimize", cacheSeed()) : cacheSeed());
+			if (imageCache->lookup(cacheKey, source.size(), output, symbolTableBytes))
 			{
-			case RecordType::RT_DEF_ADDRESS:
-				os << 0;
-				break;
-			case RecordType::RT_DEF_LITERAL:
-				os << 1;
-				break;
-			case RecordType::RT_DEF_LABEL:
-				os << 2;
-				break;
-			case RecordType::RT_INS_ADDRESS:
-				os << 3;
-				break;
-			case RecordType::RT_INS_LITERAL:
-				os << 4;
-				break;
-			case RecordType::RT_INS_LABEL:
-				os << 5;
-				break;
-			case RecordType::RT_INS_NONE:
-				os << 6;
-				break;
+				if (options.dumpIntermediate)
+				{
+					fileformat::writeBytes(options.dumpPrefix + SYMBOLTABLE_PATH, symbolTableBytes);
+				}
+				return true;
 			}
-			os << rd.tokenGroup;
-
-			return os;
 		}
 
-		friend std::ifstream& operator >> (std::ifstream& is, Record& rd)
+		// token offsets are 32 bit
+		if (source.size() > UINT32_MAX)
 		{
-			
-			RecordType type = RecordType::RT_DEF_ADDRESS;
-			tokenizer::TokenGroup tg;
-
-			char c;
-			//get record type 
-			is >> c;
-			switch (c)
-			{
-			case '0':
-				type = RecordType::RT_DEF_ADDRESS;
-				break;
-			case '1':
-				type = RecordType::RT_DEF_LITERAL;
-				break;
-			case '2':
-				type = RecordType::RT_DEF_LABEL;
-				break;
-			case '3':
-				type = RecordType::RT_INS_ADDRESS;
-				break;
-			case '4':
-				type = RecordType::RT_INS_LITERAL;
-				break;
-			case '5':
-				type = RecordType::RT_INS_LABEL;
-				break;
-			case '6':
-				type = RecordType::RT_INS_NONE;
-				break;
-			}
+			diagnostics.report(utils::ErrorType::ER_LOADING_FILE, 0);
+			return false;
+		}
 
-			//get tokengroup
-			is >> tg;
+		diagnostics.source = source;
 
-			rd = { type, tg };
+		workspace.optimization = {};
 
-			return is;
-		}
-	};
+		if (options.onePass && !options.optimize)
+		{
+			tokenizer::tokenize(source, tokens, diagnostics);
 
+			if (options.dumpIntermediate)
+			{
+				tokenizer::dumpTokens(tokens, options.dumpPrefix + TOKEN_PATH);
+			}
 
-	struct Intermediate
-	{
-		std::vector<Record> records;
-		std::vector<Label> symbolTable;
-	};
+			attachIncludes(tokens, intermediate.symbolTable, options.includeDirectory, diagnostics);
+			assembler::assembleOnePass(tokens, intermediate.symbolTable, output, diagnostics);
 
-	void findRecordType(tokenizer::TokenGroup& tokenGroup, assembler::RecordType& recordType)
-	{
-		// variable definition
-		if (tokenGroup.tokens[1].type == tokenizer::TokenType::TK_EQUAL)
-		{
-			// define address variable
-			if (tokenGroup.tokens[3].type == tokenizer::TokenType::TK_ADDRESS)
+			// images with errors differ by design
+			if (options.crossCheck && !diagnostics.hasErrors())
 			{
-				recordType = RecordType::RT_DEF_ADDRESS;
-				return;
+				Intermediate reference;
+				std::vector<unsigned char> referenceOutput;
+				utils::Diagnostics referenceDiagnostics;
+
+				reference.symbolTable.layers = intermediate.symbolTable.layers;
+				assembler::firstPass(tokens, reference, referenceDiagnostics);
+				assembler::secondPass(reference, referenceOutput, referenceDiagnostics);
+
+				if (referenceDiagnostics.hasErrors() || !std::equal(output.begin() + imageStart, output.end(), referenceOutput.begin(), referenceOutput.end()))
+				{
+					diagnostics.report(utils::ErrorType::ER_CROSS_CHECK_MISMATCH, 0);
+				}
 			}
-			// define literal variable
-			if (tokenGroup.tokens[3].type == tokenizer::TokenType::TK_LITERAL)
+
+			if (options.dumpIntermediate)
 			{
-				recordType = RecordType::RT_DEF_LITERAL;
-				return;
+				assembler::dumpIntermediate(intermediate, options.dumpPrefix);
 			}
 		}
-		
-		// define label
-		if (tokenGroup.tokens[1].type == tokenizer::TokenType::TK_COLON)
+		else if (options.threadPool != nullptr && !options.optimize && source.size() >= 2 * options.parallelChunkSize)
 		{
-			recordType = RecordType::RT_DEF_LABEL;
-			return;
+			assembleParallel(source, intermediate, output, diagnostics, options);
 		}
-
-		// instruction no operand
-		if (tokenGroup.tokens[1].type == tokenizer::TokenType::TK_NEWLINE)
+		else
 		{
-			recordType = RecordType::RT_INS_NONE;
-			return;
-		}
+			tokenizer::tokenize(source, tokens, diagnostics);
 
-		// instruction with operand
-		if (tokenGroup.tokens[1].type == tokenizer::TokenType::TK_COMMA)
-		{
-			
-			// label as operand
-			if (tokenGroup.tokens[2].type == tokenizer::TokenType::TK_SYMBOL)
-			{
-				recordType = RecordType::RT_INS_LABEL;
-				return;
-			}
-			// address as operand
-			if (tokenGroup.tokens[3].type == tokenizer::TokenType::TK_ADDRESS)
+			if (options.dumpIntermediate)
 			{
-				recordType = RecordType::RT_INS_ADDRESS;
-				return;
+				tokenizer::dumpTokens(tokens, options.dumpPrefix + TOKEN_PATH);
 			}
-			// literal as operand
-			if (tokenGroup.tokens[3].type == tokenizer::TokenType::TK_LITERAL)
-			{
-				recordType = RecordType::RT_INS_LITERAL;
-				return;
-			}
-		}
 
-		utils::Error( utils::ErrorType::ER_INVALID_TOKEN_ORDER, tokenGroup.line );
-	}
+			attachIncludes(tokens, intermediate.symbolTable, options.includeDirectory, diagnostics);
+			assembler::firstPass(tokens, intermediate, diagnostics);
 
-	void appendLabel(std::vector<Label>& symbolTable, tokenizer::Token symbol, int labelValue, OperandType type, int line)
-	{
-		for (auto& label : symbolTable)
-		{
-			if (label.token == symbol)
+			// rewriting records with errors could hide them
+			if (options.optimize && !diagnostics.hasErrors())
 			{
-				utils::Error(utils::ErrorType::ER_MULTIPLY_DEFINED_LABELS, line);
+				workspace.flowGraph.run(intermediate, workspace.optimization, diagnostics);
+				workspace.peephole.run(intermediate, workspace.optimization);
 			}
-		}
-		symbolTable.push_back({ symbol, type, labelValue });
-	}
-
-	void firstPass()
-	{
-		int locationCounter = 0;
 
-		std::ifstream tokenFile(utils::RES_PATH + TOKEN_PATH);
-
-		std::ofstream intermediateFile(utils::RES_PATH + INTERMEDIATE_PATH);
-		std::ofstream symbolTableFile(utils::RES_PATH + SYMBOLTABLE_PATH);
+			if (options.dumpIntermediate)
+			{
+				assembler::dumpIntermediate(intermediate, options.dumpPrefix);
+			}
 
-		std::vector<Label> symbolTable;
+			assembler::secondPass(intermediate, output, diagnostics);
+		}
 
-		tokenizer::TokenGroup tokenGroup;
+		diagnostics.source = {};
+		diagnostics.sort();
 
-		while (tokenFile >> tokenGroup)
+		if (diagnostics.hasErrors())
 		{
-			Record record;
-			RecordType recordType;
-
-			findRecordType(tokenGroup, recordType);
-
-			switch (recordType)
-			{
-			case RecordType::RT_DEF_ADDRESS:
-				appendLabel(symbolTable, tokenGroup.tokens[0], stoi(tokenGroup.tokens[3].value, nullptr, 16), OperandType::OT_ADDRESS, tokenGroup.line);
-				break;
-			case RecordType::RT_DEF_LITERAL:
-				appendLabel(symbolTable, tokenGroup.tokens[0], stoi(tokenGroup.tokens[3].value, nullptr, 16), OperandType::OT_LITERAL, tokenGroup.line);
-				break;
-			case RecordType::RT_DEF_LABEL:
-				appendLabel(symbolTable, tokenGroup.tokens[0], locationCounter, OperandType::OT_ADDRESS, tokenGroup.line);
-				break;
-
-			case RecordType::RT_INS_ADDRESS:
-			case RecordType::RT_INS_LITERAL:
-			case RecordType::RT_INS_LABEL:
-			case RecordType::RT_INS_NONE:
-				Operation operation = OpCodeTable[tokenGroup.tokens[0].value];
-				//validate operation
-				if (operation.mnemonic.empty())
-				{
-					utils::Error(utils::ErrorType::ER_UNRECOGNIZED_OPERATION, tokenGroup.line);
-				}
-
-				locationCounter += operation.wordSize;
-
-				Record record = { recordType, tokenGroup };
-				intermediateFile << record;
-				break;
-			}
+			return false;
 		}
 
-		for (auto& label : symbolTable)
+		if (imageCache != nullptr)
 		{
-			symbolTableFile << label;
-		}
+			std::string symbolTableBytes;
 
-		symbolTableFile.close();
-		intermediateFile.close();
-		tokenFile.close();
+			fileformat::serializeSymbolTable(intermediate.symbolTable, symbolTableBytes);
+			imageCache->store(cacheKey, source.size(), output.data() + imageStart, output.size() - imageStart, symbolTableBytes);
+		}
+		return true;
 	}
 
-	int stringHexToDecimal(std::string string)
+	bool assembleSource(std::string_view source, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, const Options& options = {})
 	{
-		int value = 0;
-		int pos = 0;
-		for each (char c in string)
-		{
-			int num;
-			switch (c)
-			{
-			case '0':
-				num = 0;
-				break;
-			case '1':
-				num = 1;
-				break;
-			case '2':
-				num = 2;
-				break;
-			case '3':
-				num = 3;
-				break;
-			case '4':
-				num = 4;
-				break;
-			case '5':
-				num = 5;
-				break;
-			case '6':
-				num = 6;
-				break;
-			case '7':
-				num = 7;
-				break;
-			case '8':
-				num = 8;
-				break;
-			case '9':
-				num = 9;
-				break;
-			default:
-				num = 0;
-				break;
-			}
-			value += num * static_cast<int>(pow(16, pos));
-			pos++;
-		}
-		return value;
+		Workspace workspace;
+		return assembleSource(source, output, diagnostics, workspace, options);
 	}
 
-	void findLabel(std::ifstream& symbolTable, std::string symbol, Label& label, int line)
+	bool assembleFile(const std::string& path, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, Workspace& workspace, const Options& options = {})
 	{
-		// reset stream pointer
-		symbolTable.seekg(0);
-
-		// find symbol in symbol table
-		Label _label;
-		while (symbolTable >> _label)
+		// tokens and labels view the mapped file, so it stays mapped until the end
+		utils::SourceBuffer source;
 		{
-			if (_label.token.value == symbol)
+			stats::Timer timer(stats::PH_READ);
+			if (!source.map(path))
 			{
-				label = _label;
-				return;
+				diagnostics.report(utils::ErrorType::ER_LOADING_FILE, 0);
+				return false;
 			}
+			stats::add(&stats::Counters::bytesRead, source.size);
 		}
-		utils::Error(utils::ErrorType::ER_INVALID_OPERAND, line);
-	}
 
-	void validateOperands(OperandType recieved, OperandType expected, int line)
-	{
-		//validate operands
-		if (recieved != expected)
+		// includes are found next to the source
+		if (options.includeDirectory.empty())
 		{
-			utils::Error(utils::ErrorType::ER_INVALID_OPERAND, line);
+			Options fileOptions = options;
+			fileOptions.includeDirectory = std::filesystem::path(path).parent_path().string();
+			return assembleSource(source.view(), output, diagnostics, workspace, fileOptions);
 		}
+		return assembleSource(source.view(), output, diagnostics, workspace, options);
 	}
 
-	void assembleInstruction(Operation& operation, Record& record, std::ifstream& symbolTable, std::ofstream& output)
+	bool assembleFile(const std::string& path, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, const Options& options = {})
 	{
-		std::string address;
-
-		switch (record.type)
-		{
-		case RecordType::RT_INS_ADDRESS:
-			
-			validateOperands(operation.operandType, OperandType::OT_ADDRESS, record.tokenGroup.line);
-
-			output << operation.opcode;
-
-			unsigned char lowerByte;
-			unsigned char upperByte;
-
-			//get address
-			address = record.tokenGroup.tokens[3].value;;
-
-			//get address value in hex
-			lowerByte = stoi(address.substr(0, 2), nullptr, 16);
-			upperByte = stoi(address.substr(2, 2), nullptr, 16);
-
-			output << lowerByte;
-			output << upperByte;
-
-			break;
-		case RecordType::RT_INS_LITERAL:
-
-			validateOperands(operation.operandType, OperandType::OT_LITERAL, record.tokenGroup.line);
-
-			output << operation.opcode;
-
-			unsigned char literal;
-
-			//get address
-			address = record.tokenGroup.tokens[3].value;;
-
-			//get address value in hex
-			literal = stoi(address.substr(0, 2), nullptr, 16);
-
-			output << literal;
-			break;
-		case RecordType::RT_INS_NONE:
-			
-			validateOperands(operation.operandType, OperandType::OT_NONE, record.tokenGroup.line);
-
-			output << operation.opcode;
-			break;
-		case RecordType::RT_INS_LABEL:
-			Label label;
-
-			findLabel(symbolTable, record.tokenGroup.tokens[2].value, label, record.tokenGroup.line);
-
-			validateOperands(operation.operandType, label.labelType, record.tokenGroup.line);
-
-			output << operation.opcode;
-
-			if (label.labelType == OperandType::OT_ADDRESS)
-			{
-				//get address
-				unsigned char lowerByte = label.labelValue >> 8;
-				unsigned char upperByte = label.labelValue;
-
-				output << lowerByte;
-				output << upperByte;
-				break;
-			}
-
-			if (label.labelType == OperandType::OT_LITERAL)
-			{
-				output << label.labelValue;
-				break;
-			}
-		}
+		Workspace workspace;
+		return assembleFile(path, output, diagnostics, workspace, options);
 	}
 
-	void secondPass(std::vector<unsigned char>& output)
+	bool assemble(std::string filename, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, Workspace& workspace, const Options& options = {})
 	{
-		std::ifstream intermediateFile(utils::RES_PATH + INTERMEDIATE_PATH);
-		std::ifstream symbolTableFile(utils::RES_PATH + SYMBOLTABLE_PATH);
-		std::ofstream outputFile(utils::RES_PATH + OBJECT_PATH);
-
-		Record record;
-		while (intermediateFile >> record)
-		{
-			Operation operation = OpCodeTable[record.tokenGroup.tokens[0].value];
-
-			assembleInstruction(operation, record, symbolTableFile, outputFile);
-		}
-
-		intermediateFile.close();
-		symbolTableFile.close();
-		outputFile.close();
+		return assembleFile(utils::RES_PATH + filename, output, diagnostics, workspace, options);
 	}
 
-	void assemble(std::string filename, std::vector<unsigned char>& output)
-	{		
-		tokenizer::tokenize(filename);
-
-		assembler::firstPass();
-
-		assembler::secondPass(output);
-
-
+	bool assemble(std::string filename, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, const Options& options = {})
+	{
+		Workspace workspace;
+		return assembleFile(utils::RES_PATH + filename, output, diagnostics, workspace, options);
 	}
-}
\ No newline at end of file
+}
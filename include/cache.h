@@ -0,0 +1,506 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+// content addressed cache of assembled images, safe to share between processes
+namespace cache
+{
+	const char ENTRY_MAGIC[4] = { 'A', 'S', 'M', 'C' };
+	const uint32_t ENTRY_VERSION = 1;
+	const std::string ENTRY_EXTENSION = ".obj";
+	const std::string STATISTICS_FILE = "stats";
+	const std::string LOCK_FILE = "stats.lock";
+
+	uint64_t rotateLeft(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	uint64_t read64(const unsigned char* data)
+	{
+		uint64_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint32_t read32(const unsigned char* data)
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	// xxHash64
+	uint64_t hash64(std::string_view bytes, uint64_t seed = 0)
+	{
+		const uint64_t P1 = 11400714785074694791ULL;
+		const uint64_t P2 = 14029467366897019727ULL;
+		const uint64_t P3 = 1609587929392839161ULL;
+		const uint64_t P4 = 9650029242287828579ULL;
+		const uint64_t P5 = 2870177450012600261ULL;
+
+		auto round = [&](uint64_t acc, uint64_t input)
+		{
+			acc += input * P2;
+			return rotateLeft(acc, 31) * P1;
+		};
+		auto merge = [&](uint64_t acc, uint64_t value)
+		{
+			acc ^= round(0, value);
+			return acc * P1 + P4;
+		};
+
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(bytes.data());
+		const unsigned char* end = p + bytes.size();
+		uint64_t hash;
+
+		if (bytes.size() >= 32)
+		{
+			uint64_t v1 = seed + P1 + P2;
+			uint64_t v2 = seed + P2;
+			uint64_t v3 = seed;
+			uint64_t v4 = seed - P1;
+
+			while (p + 32 <= end)
+			{
+				v1 = round(v1, read64(p));
+				v2 = round(v2, read64(p + 8));
+				v3 = round(v3, read64(p + 16));
+				v4 = round(v4, read64(p + 24));
+				p += 32;
+			}
+
+			hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+			hash = merge(hash, v1);
+			hash = merge(hash, v2);
+			hash = merge(hash, v3);
+			hash = merge(hash, v4);
+		}
+		else
+		{
+			hash = seed + P5;
+		}
+
+		hash += bytes.size();
+
+		for (; p + 8 <= end; p += 8)
+		{
+			hash ^= round(0, read64(p));
+			hash = rotateLeft(hash, 27) * P1 + P4;
+		}
+		if (p + 4 <= end)
+		{
+			hash ^= read32(p) * P1;
+			hash = rotateLeft(hash, 23) * P2 + P3;
+			p += 4;
+		}
+		for (; p < end; p++)
+		{
+			hash ^= *p * P5;
+			hash = rotateLeft(hash, 11) * P1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= P2;
+		hash ^= hash >> 29;
+		hash *= P3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	// unique name next to path for write then rename
+	std::filesystem::path temporaryPath(const std::filesystem::path& path)
+	{
+		std::filesystem::path temporary = path;
+		temporary += ".tmp" + std::to_string(std::random_device{}());
+		return temporary;
+	}
+
+	// exclusive advisory lock on path held for the lifetime of the object, shared
+	// between processes. locked() is false if the file cannot be opened
+	struct FileLock
+	{
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+#else
+		int fd = -1;
+#endif
+
+		explicit FileLock(const std::filesystem::path& path)
+		{
+#ifdef _WIN32
+			file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			OVERLAPPED overlapped = {};
+			if (file != INVALID_HANDLE_VALUE && !LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped))
+			{
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+			while (fd >= 0 && flock(fd, LOCK_EX) != 0)
+			{
+				if (errno != EINTR)
+				{
+					close(fd);
+					fd = -1;
+				}
+			}
+#endif
+		}
+
+		FileLock(const FileLock&) = delete;
+		FileLock& operator = (const FileLock&) = delete;
+
+		~FileLock()
+		{
+#ifdef _WIN32
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				OVERLAPPED overlapped = {};
+				UnlockFileEx(file, 0, 1, 0, &overlapped);
+				CloseHandle(file);
+			}
+#else
+			if (fd >= 0)
+			{
+				flock(fd, LOCK_UN);
+				close(fd);
+			}
+#endif
+		}
+
+		bool locked() const
+		{
+#ifdef _WIN32
+			return file != INVALID_HANDLE_VALUE;
+#else
+			return fd >= 0;
+#endif
+		}
+	};
+
+	struct EntryHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint64_t sourceSize;
+		uint32_t imageSize;
+		uint32_t symbolTableSize;
+	};
+
+	struct Statistics
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t stores = 0;
+		uint64_t evictions = 0;
+
+		void add(const Statistics& other)
+		{
+			hits += other.hits;
+			misses += other.misses;
+			stores += other.stores;
+			evictions += other.evictions;
+		}
+
+		friend std::ostream& operator << (std::ostream& os, const Statistics& st)
+		{
+			os << "hits " << st.hits << '\n';
+			os << "misses " << st.misses << '\n';
+			os << "stores " << st.stores << '\n';
+			os << "evictions " << st.evictions << '\n';
+
+			return os;
+		}
+
+		friend std::istream& operator >> (std::istream& is, Statistics& st)
+		{
+			std::string name;
+			uint64_t value;
+
+			while (is >> name >> value)
+			{
+				if (name == "hits") st.hits = value;
+				if (name == "misses") st.misses = value;
+				if (name == "stores") st.stores = value;
+				if (name == "evictions") st.evictions = value;
+			}
+
+			return is;
+		}
+	};
+
+	struct Cache
+	{
+		std::filesystem::path directory;
+		// size bound of all entries, least recently used entries are evicted past it
+		uint64_t maxSize = 0;
+		// size of all entries at the last scan of the directory plus what this process
+		// stored since. stores of other processes show up at the next scan
+		uint64_t size = 0;
+		// counted by this process and not yet added to the statistics file
+		Statistics statistics;
+		std::mutex mutex;
+
+		Cache() = default;
+		Cache(const Cache&) = delete;
+		Cache& operator = (const Cache&) = delete;
+
+		~Cache()
+		{
+			flushStatistics();
+		}
+
+		bool open(const std::string& path, uint64_t _maxSize)
+		{
+			std::error_code error;
+
+			directory = path;
+			maxSize = _maxSize;
+			std::filesystem::create_directories(directory, error);
+			if (!std::filesystem::is_directory(directory, error))
+			{
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			evict();
+			return true;
+		}
+
+		bool isOpen() const
+		{
+			return !directory.empty();
+		}
+
+		std::filesystem::path entryPath(uint64_t key) const
+		{
+			char name[17];
+			snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+			return directory / (name + ENTRY_EXTENSION);
+		}
+
+		// appends the cached image to image and fills symbolTable on a hit
+		bool lookup(uint64_t key, uint64_t sourceSize, std::vector<unsigned char>& image, std::string& symbolTable)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::filesystem::path path = entryPath(key);
+
+			std::ifstream file(path, std::ios::binary);
+			EntryHeader header;
+			if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+				memcmp(header.magic, ENTRY_MAGIC, 4) != 0 || header.version != ENTRY_VERSION ||
+				header.key != key || header.sourceSize != sourceSize)
+			{
+				statistics.misses++;
+				return false;
+			}
+
+			size_t start = image.size();
+			image.resize(start + header.imageSize);
+			symbolTable.resize(header.symbolTableSize);
+			if (!file.read(reinterpret_cast<char*>(image.data() + start), header.imageSize) || !file.read(&symbolTable[0], symbolTable.size()))
+			{
+				image.resize(start);
+				symbolTable.clear();
+				statistics.misses++;
+				return false;
+			}
+			file.close();
+
+			// the modification time is the lru order
+			std::error_code error;
+			std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+			statistics.hits++;
+			return true;
+		}
+
+		void store(uint64_t key, uint64_t sourceSize, const unsigned char* image, size_t imageSize, const std::string& symbolTable)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::filesystem::path path = entryPath(key);
+
+			EntryHeader header = {};
+			memcpy(header.magic, ENTRY_MAGIC, 4);
+			header.version = ENTRY_VERSION;
+			header.key = key;
+			header.sourceSize = sourceSize;
+			header.imageSize = static_cast<uint32_t>(imageSize);
+			header.symbolTableSize = static_cast<uint32_t>(symbolTable.size());
+
+			// write then rename, so other processes never see half an entry
+			std::filesystem::path temporary = temporaryPath(path);
+			{
+				std::ofstream file(temporary, std::ios::binary);
+				file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				file.write(reinterpret_cast<const char*>(image), imageSize);
+				file.write(symbolTable.data(), symbolTable.size());
+				if (!file.good())
+				{
+					file.close();
+					std::error_code error;
+					std::filesystem::remove(temporary, error);
+					return;
+				}
+			}
+
+			// another process may have stored the same entry already
+			std::error_code error;
+			uint64_t replaced = std::filesystem::file_size(path, error);
+			if (error)
+			{
+				replaced = 0;
+			}
+
+			std::filesystem::rename(temporary, path, error);
+			if (error)
+			{
+				std::filesystem::remove(temporary, error);
+				return;
+			}
+
+			statistics.stores++;
+			size += sizeof(header) + imageSize + symbolTable.size();
+			size -= std::min(size, replaced);
+			if (size > maxSize)
+			{
+				evict();
+			}
+		}
+
+		// scans the directory for the size of all entries and drops least recently used
+		// ones until the cache fits maxSize
+		void evict()
+		{
+			struct Entry
+			{
+				std::filesystem::path path;
+				std::filesystem::file_time_type time;
+				uint64_t size;
+			};
+
+			std::vector<Entry> entries;
+			uint64_t totalSize = 0;
+
+			std::error_code error;
+			for (auto& file : std::filesystem::directory_iterator(directory, error))
+			{
+				if (file.path().extension() != ENTRY_EXTENSION)
+				{
+					continue;
+				}
+				Entry entry = { file.path(), file.last_write_time(error), file.file_size(error) };
+				if (error)
+				{
+					continue;
+				}
+				totalSize += entry.size;
+				entries.push_back(entry);
+			}
+
+			size = totalSize;
+			if (totalSize <= maxSize)
+			{
+				return;
+			}
+
+			std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+			for (auto& entry : entries)
+			{
+				if (totalSize <= maxSize)
+				{
+					break;
+				}
+				if (std::filesystem::remove(entry.path, error))
+				{
+					totalSize -= entry.size;
+					statistics.evictions++;
+				}
+			}
+			size = totalSize;
+		}
+
+		// statistics of every process that used this directory, including this one
+		Statistics totals()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			// the file is replaced by a rename, a reader sees the old or the new one
+			Statistics total;
+			std::ifstream file(directory / STATISTICS_FILE);
+			file >> total;
+			total.add(statistics);
+
+			return total;
+		}
+
+		// adds the counts of this process to the statistics file. the read, add and
+		// write happen under the lock file so concurrent processes lose no counts
+		void flushStatistics()
+		{
+			if (!isOpen())
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			FileLock fileLock(directory / LOCK_FILE);
+			if (!fileLock.locked())
+			{
+				return;
+			}
+
+			std::filesystem::path path = directory / STATISTICS_FILE;
+			Statistics total;
+			{
+				std::ifstream file(path);
+				file >> total;
+			}
+			total.add(statistics);
+
+			std::filesystem::path temporary = temporaryPath(path);
+			{
+				std::ofstream file(temporary);
+				file << total;
+			}
+
+			std::error_code error;
+			std::filesystem::rename(temporary, path, error);
+			if (error)
+			{
+				std::filesystem::remove(temporary, error);
+				return;
+			}
+			statistics = {};
+		}
+	};
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHARCLASS_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CHARCLASS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CHARCLASS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CHARCLASS_TARGET_AVX2
+#endif
+
+namespace tokenizer
+{
+	enum CharClass : unsigned char
+	{
+		CC_INVALID = 0,
+		CC_SPACE = 1 << 0,		// ' ' '\t'
+		CC_IDENT = 1 << 1,		// a-z A-Z 0-9 _ - .
+		CC_HEX = 1 << 2,		// 0-9 a-f A-F
+		CC_PUNCT = 1 << 3,		// % $ = : , '\n'
+	};
+
+	constexpr std::array<unsigned char, 256> makeCharClassTable()
+	{
+		std::array<unsigned char, 256> table = {};
+
+		table[' '] = CC_SPACE;
+		table['\t'] = CC_SPACE;
+
+		for (int c = 'a'; c <= 'z'; c++)
+		{
+			table[c] |= CC_IDENT;
+			table[c - 'a' + 'A'] |= CC_IDENT;
+		}
+		for (int c = '0'; c <= '9'; c++)
+		{
+			table[c] |= CC_IDENT | CC_HEX;
+		}
+		for (int c = 'a'; c <= 'f'; c++)
+		{
+			table[c] |= CC_HEX;
+			table[c - 'a' + 'A'] |= CC_HEX;
+		}
+		table['_'] |= CC_IDENT;
+		table['-'] |= CC_IDENT;
+		table['.'] |= CC_IDENT;
+
+		table['%'] = CC_PUNCT;
+		table['$'] = CC_PUNCT;
+		table['='] = CC_PUNCT;
+		table[':'] = CC_PUNCT;
+		table[','] = CC_PUNCT;
+		table['\n'] = CC_PUNCT;
+
+		return table;
+	}
+
+	constexpr std::array<unsigned char, 256> CharClassTable = makeCharClassTable();
+
+	unsigned char charClass(char c)
+	{
+		return CharClassTable[static_cast<unsigned char>(c)];
+	}
+
+	// number of leading characters of [data, data + size) that all belong to charClass
+	size_t scanClassScalar(const char* data, size_t size, unsigned char cls)
+	{
+		size_t i = 0;
+		while (i < size && (charClass(data[i]) & cls))
+		{
+			i++;
+		}
+		return i;
+	}
+
+	struct ScanKernels
+	{
+		const char* name;
+		size_t(*skipWhitespace)(const char* data, size_t size);
+		size_t(*scanIdentifier)(const char* data, size_t size);
+		size_t(*scanHex)(const char* data, size_t size);
+	};
+
+	namespace scalar
+	{
+		size_t skipWhitespace(const char* data, size_t size) { return scanClassScalar(data, size, CC_SPACE); }
+		size_t scanIdentifier(const char* data, size_t size) { return scanClassScalar(data, size, CC_IDENT); }
+		size_t scanHex(const char* data, size_t size) { return scanClassScalar(data, size, CC_HEX); }
+	}
+
+#ifdef CHARCLASS_X86
+	unsigned int countTrailingZeros(unsigned int mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	namespace sse2
+	{
+		// all bytes of v in [low, high], signed compares are fine since both bounds are ascii
+		__m128i inRange(__m128i v, char low, char high)
+		{
+			return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1)));
+		}
+
+		__m128i whitespaceMask(__m128i v)
+		{
+			return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+		}
+
+		__m128i identifierMask(__m128i v)
+		{
+			__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+			__m128i mask = _mm_or_si128(inRange(lower, 'a', 'z'), inRange(v, '0', '9'));
+			mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+			mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+			return _mm_or_si128(mask, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+		}
+
+		__m128i hexMask(__m128i v)
+		{
+			__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+			return _mm_or_si128(inRange(lower, 'a', 'f'), inRange(v, '0', '9'));
+		}
+
+		template <__m128i(*Mask)(__m128i), unsigned char Class>
+		size_t scan(const char* data, size_t size)
+		{
+			size_t i = 0;
+			for (; i + 16 <= size; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				unsigned int miss = ~static_cast<unsigned int>(_mm_movemask_epi8(Mask(v))) & 0xFFFF;
+				if (miss != 0)
+				{
+					return i + countTrailingZeros(miss);
+				}
+			}
+			return i + scanClassScalar(data + i, size - i, Class);
+		}
+
+		size_t skipWhitespace(const char* data, size_t size) { return scan<whitespaceMask, CC_SPACE>(data, size); }
+		size_t scanIdentifier(const char* data, size_t size) { return scan<identifierMask, CC_IDENT>(data, size); }
+		size_t scanHex(const char* data, size_t size) { return scan<hexMask, CC_HEX>(data, size); }
+	}
+
+	namespace avx2
+	{
+		CHARCLASS_TARGET_AVX2 __m256i inRange(__m256i v, char low, char high)
+		{
+			return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(low - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), v));
+		}
+
+		CHARCLASS_TARGET_AVX2 __m256i whitespaceMask(__m256i v)
+		{
+			return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+		}
+
+		CHARCLASS_TARGET_AVX2 __m256i identifierMask(__m256i v)
+		{
+			__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+			__m256i mask = _mm256_or_si256(inRange(lower, 'a', 'z'), inRange(v, '0', '9'));
+			mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+			mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+			return _mm256_or_si256(mask, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+		}
+
+		CHARCLASS_TARGET_AVX2 __m256i hexMask(__m256i v)
+		{
+			__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+			return _mm256_or_si256(inRange(lower, 'a', 'f'), inRange(v, '0', '9'));
+		}
+
+		template <__m256i(*Mask)(__m256i), unsigned char Class>
+		CHARCLASS_TARGET_AVX2 size_t scan(const char* data, size_t size)
+		{
+			size_t i = 0;
+			for (; i + 32 <= size; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				unsigned int miss = ~static_cast<unsigned int>(_mm256_movemask_epi8(Mask(v)));
+				if (miss != 0)
+				{
+					return i + countTrailingZeros(miss);
+				}
+			}
+			return i + scanClassScalar(data + i, size - i, Class);
+		}
+
+		CHARCLASS_TARGET_AVX2 size_t skipWhitespace(const char* data, size_t size) { return scan<whitespaceMask, CC_SPACE>(data, size); }
+		CHARCLASS_TARGET_AVX2 size_t scanIdentifier(const char* data, size_t size) { return scan<identifierMask, CC_IDENT>(data, size); }
+		CHARCLASS_TARGET_AVX2 size_t scanHex(const char* data, size_t size) { return scan<hexMask, CC_HEX>(data, size); }
+	}
+
+	bool cpuSupportsAvx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		// the os has to save the ymm registers as well
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	const ScanKernels ScalarKernels = { "scalar", scalar::skipWhitespace, scalar::scanIdentifier, scalar::scanHex };
+#ifdef CHARCLASS_X86
+	const ScanKernels Sse2Kernels = { "sse2", sse2::skipWhitespace, sse2::scanIdentifier, sse2::scanHex };
+	const ScanKernels Avx2Kernels = { "avx2", avx2::skipWhitespace, avx2::scanIdentifier, avx2::scanHex };
+	// the wider loads only pay off on runs of 16 bytes and more (assembler_bench
+	// --kernels). identifiers and hex operands are a few characters long and stay on
+	// sse2, whitespace can be long alignment padding
+	const ScanKernels Avx2WhitespaceKernels = { "avx2+sse2", avx2::skipWhitespace, sse2::scanIdentifier, sse2::scanHex };
+#endif
+
+	// fastest kernels the running cpu supports, picked once
+	const ScanKernels& scanKernels()
+	{
+#ifdef CHARCLASS_X86
+		static const ScanKernels& kernels = cpuSupportsAvx2() ? Avx2WhitespaceKernels : Sse2Kernels;
+		return kernels;
+#else
+		return ScalarKernels;
+#endif
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "utils.h"
+
+namespace utils
+{
+	enum class Severity
+	{
+		SV_WARNING,
+		SV_ERROR,
+		SV_FATAL
+	};
+
+	struct Diagnostic
+	{
+		ErrorType type;
+		Severity severity;
+		int64_t line;
+		// 1 based, 0 if the error has no position in the source
+		int column;
+		// bytes of the source the error points at
+		size_t offset;
+		size_t length;
+
+		unsigned int code() const
+		{
+			return ErrorInfoMap.at(type).errorCode;
+		}
+
+		friend std::ostream& operator << (std::ostream& os, const Diagnostic& diagnostic)
+		{
+			switch (diagnostic.severity)
+			{
+			case Severity::SV_WARNING:
+				os << "Warning";
+				break;
+			case Severity::SV_ERROR:
+				os << "Error  ";
+				break;
+			case Severity::SV_FATAL:
+				os << "Fatal  ";
+				break;
+			}
+
+			os << "E" << diagnostic.code() << "  " << ErrorInfoMap.at(diagnostic.type).errorMessage << "  ( line : " << diagnostic.line;
+			if (diagnostic.column != 0)
+			{
+				os << ", column : " << diagnostic.column;
+			}
+			os << " )\n";
+
+			return os;
+		}
+	};
+
+	// errors of one assembly job, collected instead of terminating the process
+	struct Diagnostics
+	{
+		// source of the running job, spans passed to report point into it
+		std::string_view source;
+		std::vector<Diagnostic> entries;
+		size_t errorCount = 0;
+		// entries kept, later errors are only counted
+		size_t limit = 1000;
+
+		void report(ErrorType type, int64_t line, std::string_view span = {})
+		{
+			Severity severity = ErrorInfoMap.at(type).fatal ? Severity::SV_FATAL : Severity::SV_ERROR;
+			if (severity != Severity::SV_WARNING)
+			{
+				errorCount++;
+			}
+			if (entries.size() >= limit)
+			{
+				return;
+			}
+
+			Diagnostic diagnostic = { type, severity, line, 0, 0, 0 };
+
+			if (span.data() != nullptr && span.data() >= source.data() && span.data() <= source.data() + source.size())
+			{
+				size_t offset = span.data() - source.data();
+				size_t lineStart = offset;
+				while (lineStart > 0 && source[lineStart - 1] != '\n')
+				{
+					lineStart--;
+				}
+
+				diagnostic.column = static_cast<int>(offset - lineStart + 1);
+				diagnostic.offset = offset;
+				diagnostic.length = span.size();
+			}
+
+			entries.push_back(diagnostic);
+		}
+
+		// take over the diagnostics of a part of the same job
+		void append(const Diagnostics& other)
+		{
+			errorCount += other.errorCount;
+			for (auto& diagnostic : other.entries)
+			{
+				if (entries.size() >= limit)
+				{
+					break;
+				}
+				entries.push_back(diagnostic);
+			}
+		}
+
+		// passes report in their own order, present them by position
+		void sort()
+		{
+			std::stable_sort(entries.begin(), entries.end(), [](const Diagnostic& a, const Diagnostic& b)
+			{
+				return a.line != b.line ? a.line < b.line : a.column < b.column;
+			});
+		}
+
+		bool hasErrors() const
+		{
+			return errorCount != 0;
+		}
+
+		void clear()
+		{
+			source = {};
+			entries.clear();
+			errorCount = 0;
+		}
+
+		friend std::ostream& operator << (std::ostream& os, const Diagnostics& diagnostics)
+		{
+			for (auto& diagnostic : diagnostics.entries)
+			{
+				os << diagnostic;
+			}
+			if (diagnostics.errorCount > diagnostics.entries.size())
+			{
+				os << diagnostics.errorCount - diagnostics.entries.size() << " more errors\n";
+			}
+
+			return os;
+		}
+	};
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stats.h"
+
+// writes finished images. every format is encoded into one buffer sized up front and
+// written with a single call, raw images straight from the image itself
+namespace emitter
+{
+	enum class Format
+	{
+		OF_RAW,
+		// Intel HEX, 16 data bytes per record
+		OF_INTEL_HEX,
+		// C header with the image as a byte array
+		OF_C_ARRAY
+	};
+
+	// raw, hex or c
+	bool parseFormat(std::string_view name, Format& format)
+	{
+		if (name == "raw")
+		{
+			format = Format::OF_RAW;
+			return true;
+		}
+		if (name == "hex")
+		{
+			format = Format::OF_INTEL_HEX;
+			return true;
+		}
+		if (name == "c")
+		{
+			format = Format::OF_C_ARRAY;
+			return true;
+		}
+		return false;
+	}
+
+	// file extension batch and compile jobs give their images
+	const char* extension(Format format)
+	{
+		switch (format)
+		{
+		case Format::OF_INTEL_HEX:
+			return ".hex";
+		case Format::OF_C_ARRAY:
+			return ".h";
+		default:
+			return ".out";
+		}
+	}
+
+	const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+	void appendHexByte(std::string& text, uint8_t byte)
+	{
+		text += HEX_DIGITS[byte >> 4];
+		text += HEX_DIGITS[byte & 0x0F];
+	}
+
+	// one record, the checksum makes the sum of its bytes 0
+	void appendHexRecord(std::string& text, uint8_t type, uint16_t address, const unsigned char* data, size_t size)
+	{
+		uint8_t sum = static_cast<uint8_t>(size + (address >> 8) + address + type);
+
+		text += ':';
+		appendHexByte(text, static_cast<uint8_t>(size));
+		appendHexByte(text, static_cast<uint8_t>(address >> 8));
+		appendHexByte(text, static_cast<uint8_t>(address));
+		appendHexByte(text, type);
+		for (size_t i = 0; i < size; i++)
+		{
+			appendHexByte(text, data[i]);
+			sum = static_cast<uint8_t>(sum + data[i]);
+		}
+		appendHexByte(text, static_cast<uint8_t>(-sum));
+		text += '\n';
+	}
+
+	void encodeIntelHex(const unsigned char* image, size_t size, std::string& text)
+	{
+		const size_t RECORD_SIZE = 16;
+
+		text.clear();
+		// 12 characters around the data of every record, the extended address ones
+		// and the end record
+		text.reserve((size / RECORD_SIZE + 1) * (12 + 2 * RECORD_SIZE) + (size >> 16) * 16 + 12);
+
+		for (size_t address = 0; address < size; address += RECORD_SIZE)
+		{
+			// images past 64 KiB get an extended linear address record per segment
+			if (address != 0 && (address & 0xFFFF) == 0)
+			{
+				unsigned char segment[2] = { static_cast<unsigned char>(address >> 24), static_cast<unsigned char>(address >> 16) };
+				appendHexRecord(text, 0x04, 0, segment, 2);
+			}
+			appendHexRecord(text, 0x00, static_cast<uint16_t>(address), image + address, std::min(RECORD_SIZE, size - address));
+		}
+		appendHexRecord(text, 0x01, 0, nullptr, 0);
+	}
+
+	// name turned into a C identifier
+	std::string identifier(std::string_view name)
+	{
+		std::string result = name.empty() || (name[0] >= '0' && name[0] <= '9') ? "_" : "";
+		for (char c : name)
+		{
+			bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+			result += valid ? c : '_';
+		}
+		return result;
+	}
+
+	void encodeCArray(const unsigned char* image, size_t size, std::string_view name, std::string& text)
+	{
+		const size_t LINE_SIZE = 12;
+		std::string array = identifier(name);
+
+		text.clear();
+		text.reserve(size * 6 + size / LINE_SIZE * 2 + array.size() * 2 + 96);
+
+		text += "#pragma once\n\n";
+		text += "static const unsigned int " + array + "_size = " + std::to_string(size) + ";\n";
+		text += "static const unsigned char " + array + "[] =\n{";
+		for (size_t i = 0; i < size; i++)
+		{
+			text += i % LINE_SIZE == 0 ? "\n\t" : " ";
+			text += "0x";
+			appendHexByte(text, image[i]);
+			text += ',';
+		}
+		text += "\n};\n";
+	}
+
+	// the image in format, the C array is named after the file
+	bool writeImage(const std::vector<unsigned char>& image, const std::string& path, Format format = Format::OF_RAW)
+	{
+		stats::Timer timer(stats::PH_WRITE);
+
+		std::string text;
+		const char* data = reinterpret_cast<const char*>(image.data());
+		size_t size = image.size();
+
+		if (format == Format::OF_INTEL_HEX)
+		{
+			encodeIntelHex(image.data(), image.size(), text);
+		}
+		if (format == Format::OF_C_ARRAY)
+		{
+			std::string_view name = path;
+			name = name.substr(name.find_last_of("/\\") + 1);
+			encodeCArray(image.data(), image.size(), name.substr(0, name.find('.')), text);
+		}
+		if (format != Format::OF_RAW)
+		{
+			data = text.data();
+			size = text.size();
+		}
+
+		stats::add(&stats::Counters::bytesWritten, size);
+
+		std::ofstream file(path, std::ios::binary);
+		file.write(data, static_cast<std::streamsize>(size));
+		file.close();
+		return file.good();
+	}
+}
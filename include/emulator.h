@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "passes.h"
+#include "semantics.h"
+
+// runs assembled images : one 8 bit accumulator, carry and zero flags and 64 KiB of
+// memory holding the image from address 0
+namespace emulator
+{
+	const size_t MEMORY_SIZE = 1 << 16;
+
+	enum class Status
+	{
+		ST_HALTED,
+		ST_BUDGET_EXHAUSTED,
+		ST_INVALID_OPCODE
+	};
+
+	struct Machine
+	{
+		std::vector<unsigned char> memory = std::vector<unsigned char>(MEMORY_SIZE);
+		uint16_t pc = 0;
+		uint8_t a = 0;
+		bool carry = false;
+		bool zero = false;
+
+		uint64_t executed = 0;
+		// values PRT printed, in order, up to printLimit of them
+		std::vector<unsigned char> printed;
+		size_t printLimit = 1 << 20;
+		uint64_t printCount = 0;
+
+		// clears the machine and copies the image to address 0, longer images are cut
+		void load(const unsigned char* image, size_t size)
+		{
+			std::fill(memory.begin(), memory.end(), 0);
+			std::copy(image, image + std::min(size, MEMORY_SIZE), memory.begin());
+			pc = 0;
+			a = 0;
+			carry = false;
+			zero = false;
+			executed = 0;
+			printed.clear();
+			printCount = 0;
+		}
+
+		void load(const std::vector<unsigned char>& image)
+		{
+			load(image.data(), image.size());
+		}
+	};
+
+	// executes until HLT, an unused opcode or budget instructions. flags change on
+	// ADD, ADI, SUB and SUI only : carry is the carry out of an addition and set for a
+	// subtraction without borrow, zero is set for a zero result
+	Status run(Machine& machine, uint64_t budget)
+	{
+		const unsigned char* semantics = isa::semanticTable();
+		unsigned char* memory = machine.memory.data();
+
+		uint16_t pc = machine.pc;
+		uint8_t a = machine.a;
+		bool carry = machine.carry;
+		bool zero = machine.zero;
+		uint64_t remaining = budget;
+		Status status = Status::ST_BUDGET_EXHAUSTED;
+
+		unsigned int operand;
+		unsigned int result;
+
+		// big endian operand address after the opcode, wrapping at the end of memory
+#define EMULATOR_ADDRESS() ((memory[static_cast<uint16_t>(pc + 1)] << 8) | memory[static_cast<uint16_t>(pc + 2)])
+#define EMULATOR_LITERAL() (memory[static_cast<uint16_t>(pc + 1)])
+
+#if defined(__GNUC__) || defined(__clang__)
+		// computed goto, one indirect jump per instruction
+		static void* const handlers[isa::SM_INVALID + 1] =
+		{
+			&&op_hlt, &&op_lda, &&op_ldi, &&op_add, &&op_adi, &&op_sub, &&op_sui,
+			&&op_sta, &&op_jmp, &&op_jc, &&op_jz, &&op_prt, &&op_nop, &&op_invalid
+		};
+		// straight from opcode to handler
+		void* dispatch[256];
+		for (int opcode = 0; opcode < 256; opcode++)
+		{
+			dispatch[opcode] = handlers[semantics[opcode]];
+		}
+
+#define EMULATOR_CASE(label, semantic) label:
+#define EMULATOR_NEXT() \
+		if (remaining == 0) goto done; \
+		remaining--; \
+		goto *dispatch[memory[pc]]
+
+		EMULATOR_NEXT();
+#else
+#define EMULATOR_CASE(label, semantic) case semantic:
+#define EMULATOR_NEXT() continue
+
+		for (;;)
+		{
+			if (remaining == 0)
+			{
+				goto done;
+			}
+			remaining--;
+
+			switch (semantics[memory[pc]])
+			{
+#endif
+		EMULATOR_CASE(op_hlt, isa::SM_HLT)
+			status = Status::ST_HALTED;
+			goto done;
+
+		EMULATOR_CASE(op_lda, isa::SM_LDA)
+			a = memory[EMULATOR_ADDRESS()];
+			pc += 3;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_ldi, isa::SM_LDI)
+			a = EMULATOR_LITERAL();
+			pc += 2;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_add, isa::SM_ADD)
+			operand = memory[EMULATOR_ADDRESS()];
+			pc += 3;
+			result = a + operand;
+			carry = result > 0xFF;
+			a = static_cast<uint8_t>(result);
+			zero = a == 0;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_adi, isa::SM_ADI)
+			operand = EMULATOR_LITERAL();
+			pc += 2;
+			result = a + operand;
+			carry = result > 0xFF;
+			a = static_cast<uint8_t>(result);
+			zero = a == 0;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_sub, isa::SM_SUB)
+			operand = memory[EMULATOR_ADDRESS()];
+			pc += 3;
+			carry = a >= operand;
+			a = static_cast<uint8_t>(a - operand);
+			zero = a == 0;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_sui, isa::SM_SUI)
+			operand = EMULATOR_LITERAL();
+			pc += 2;
+			carry = a >= operand;
+			a = static_cast<uint8_t>(a - operand);
+			zero = a == 0;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_sta, isa::SM_STA)
+			memory[EMULATOR_ADDRESS()] = a;
+			pc += 3;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_jmp, isa::SM_JMP)
+			pc = static_cast<uint16_t>(EMULATOR_ADDRESS());
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_jc, isa::SM_JC)
+			pc = carry ? static_cast<uint16_t>(EMULATOR_ADDRESS()) : static_cast<uint16_t>(pc + 3);
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_jz, isa::SM_JZ)
+			pc = zero ? static_cast<uint16_t>(EMULATOR_ADDRESS()) : static_cast<uint16_t>(pc + 3);
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_prt, isa::SM_PRT)
+			if (machine.printed.size() < machine.printLimit)
+			{
+				machine.printed.push_back(a);
+			}
+			machine.printCount++;
+			pc += 1;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_nop, isa::SM_NOP)
+			pc += 1;
+			EMULATOR_NEXT();
+
+		EMULATOR_CASE(op_invalid, isa::SM_INVALID)
+			status = Status::ST_INVALID_OPCODE;
+			goto done;
+
+#if !(defined(__GNUC__) || defined(__clang__))
+			}
+		}
+#endif
+
+#undef EMULATOR_ADDRESS
+#undef EMULATOR_LITERAL
+#undef EMULATOR_CASE
+#undef EMULATOR_NEXT
+
+	done:
+		// the stopping instruction counts as executed
+		machine.pc = pc;
+		machine.a = a;
+		machine.carry = carry;
+		machine.zero = zero;
+		machine.executed += budget - remaining;
+		return status;
+	}
+
+	const char* statusName(Status status)
+	{
+		switch (status)
+		{
+		case Status::ST_HALTED:
+			return "halted";
+		case Status::ST_BUDGET_EXHAUSTED:
+			return "budget exhausted";
+		default:
+			return "invalid opcode";
+		}
+	}
+}
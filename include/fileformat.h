@@ -0,0 +1,462 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sourcebuffer.h"
+#include "symboltable.h"
+
+// fixed layout binary files shared with other tools, all fields are little endian
+namespace fileformat
+{
+	const uint16_t FORMAT_VERSION = 1;
+
+	const char INTERMEDIATE_MAGIC[4] = { 'A', 'S', 'M', 'I' };
+	const char SYMBOLTABLE_MAGIC[4] = { 'A', 'S', 'M', 'S' };
+	const char SNAPSHOT_MAGIC[4] = { 'A', 'S', 'M', 'P' };
+	const char OBJECT_MAGIC[4] = { 'A', 'S', 'M', 'O' };
+
+	// file layout : header | entries | string pool
+	struct FileHeader
+	{
+		char magic[4];
+		uint16_t version;
+		uint16_t entrySize;
+		uint32_t entryCount;
+		uint32_t entryOffset;
+		uint32_t stringPoolOffset;
+		uint32_t stringPoolSize;
+		uint32_t reserved[2];
+	};
+
+	struct RecordEntry
+	{
+		uint8_t type;			// assembler::RecordType
+		uint8_t reserved[3];
+		int32_t line;
+		uint32_t mnemonicOffset;
+		uint32_t mnemonicLength;
+		uint32_t operandOffset;	// operand symbol, address or literal, empty if none
+		uint32_t operandLength;
+	};
+
+	struct LabelEntry
+	{
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint8_t type;			// assembler::OperandType
+		uint8_t reserved[3];
+		int32_t value;
+	};
+
+	// hash index of a snapshot, the open addressing slots of assembler::SymbolTable
+	struct SlotEntry
+	{
+		uint32_t hash;
+		uint32_t index;
+	};
+
+	// relocatable object, layout : header | symbols | relocations | code | string pool
+	struct ObjectHeader
+	{
+		char magic[4];
+		uint16_t version;
+		uint16_t reserved;
+		uint32_t symbolOffset;
+		uint32_t symbolCount;
+		uint32_t relocationOffset;
+		uint32_t relocationCount;
+		uint32_t codeOffset;
+		uint32_t codeSize;
+		uint32_t stringPoolOffset;
+		uint32_t stringPoolSize;
+	};
+
+	enum class SymbolBinding : uint8_t
+	{
+		// a = definition, the value is final
+		SB_ABSOLUTE,
+		// a location label, the value is an offset into the code of the module
+		SB_RELATIVE,
+		// used by the module and defined by another one
+		SB_IMPORT
+	};
+
+	struct SymbolEntry
+	{
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint8_t type;			// assembler::OperandType
+		uint8_t binding;		// SymbolBinding
+		uint8_t reserved[2];
+		int32_t value;
+	};
+
+	// an operand the linker fills in, big endian as in the image
+	struct RelocationEntry
+	{
+		uint32_t offset;		// first operand byte in the code
+		uint32_t symbol;		// an import, or NO_SYMBOL to add the address of the module
+		uint8_t type;			// assembler::OperandType the instruction expects
+		uint8_t reserved[3];
+		int32_t line;
+	};
+
+	const uint32_t NO_SYMBOL = UINT32_MAX;
+
+	static_assert(sizeof(FileHeader) == 32, "FileHeader layout changed");
+	static_assert(sizeof(RecordEntry) == 24, "RecordEntry layout changed");
+	static_assert(sizeof(LabelEntry) == 16, "LabelEntry layout changed");
+	static_assert(sizeof(SlotEntry) == sizeof(assembler::SymbolTable::Slot), "SlotEntry layout changed");
+	static_assert(sizeof(ObjectHeader) == 40, "ObjectHeader layout changed");
+	static_assert(sizeof(SymbolEntry) == 16, "SymbolEntry layout changed");
+	static_assert(sizeof(RelocationEntry) == 16, "RelocationEntry layout changed");
+
+	struct StringPool
+	{
+		std::string data;
+
+		uint32_t add(std::string_view string)
+		{
+			uint32_t offset = static_cast<uint32_t>(data.size());
+			data.append(string);
+			return offset;
+		}
+	};
+
+	template <typename Entry>
+	void serialize(const char magic[4], const std::vector<Entry>& entries, const StringPool& pool, std::string& bytes)
+	{
+		FileHeader header = {};
+		memcpy(header.magic, magic, 4);
+		header.version = FORMAT_VERSION;
+		header.entrySize = sizeof(Entry);
+		header.entryCount = static_cast<uint32_t>(entries.size());
+		header.entryOffset = sizeof(FileHeader);
+		header.stringPoolOffset = static_cast<uint32_t>(header.entryOffset + entries.size() * sizeof(Entry));
+		header.stringPoolSize = static_cast<uint32_t>(pool.data.size());
+
+		bytes.clear();
+		bytes.reserve(header.stringPoolOffset + header.stringPoolSize);
+		bytes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		bytes.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+		bytes.append(pool.data);
+	}
+
+	bool writeBytes(const std::string& path, const std::string& bytes)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(bytes.data(), bytes.size());
+		return file.good();
+	}
+
+	// validated in place view of a mapped or caller provided file
+	template <typename Entry>
+	struct FileView
+	{
+		utils::SourceBuffer buffer;
+		const FileHeader* header = nullptr;
+		const Entry* entries = nullptr;
+		const char* pool = nullptr;
+
+		bool open(const std::string& path, const char magic[4])
+		{
+			if (!buffer.map(path))
+			{
+				return false;
+			}
+			return validate(magic);
+		}
+
+		// bytes has to outlive the view
+		bool open(std::string_view bytes, const char magic[4])
+		{
+			buffer.assign(bytes);
+			return validate(magic);
+		}
+
+		bool validate(const char magic[4])
+		{
+			header = nullptr;
+			entries = nullptr;
+			pool = nullptr;
+
+			if (buffer.size < sizeof(FileHeader))
+			{
+				return false;
+			}
+
+			const FileHeader* _header = reinterpret_cast<const FileHeader*>(buffer.data);
+			if (memcmp(_header->magic, magic, 4) != 0 || _header->version != FORMAT_VERSION || _header->entrySize != sizeof(Entry))
+			{
+				return false;
+			}
+			if (_header->entryOffset % alignof(Entry) != 0 ||
+				static_cast<uint64_t>(_header->entryOffset) + static_cast<uint64_t>(_header->entryCount) * sizeof(Entry) > buffer.size ||
+				static_cast<uint64_t>(_header->stringPoolOffset) + _header->stringPoolSize > buffer.size)
+			{
+				return false;
+			}
+
+			header = _header;
+			entries = reinterpret_cast<const Entry*>(buffer.data + header->entryOffset);
+			pool = buffer.data + header->stringPoolOffset;
+			return true;
+		}
+
+		size_t size() const
+		{
+			return header ? header->entryCount : 0;
+		}
+
+		const Entry& operator [] (size_t i) const
+		{
+			return entries[i];
+		}
+
+		// out of range strings read as empty
+		std::string_view string(uint32_t offset, uint32_t length) const
+		{
+			if (static_cast<uint64_t>(offset) + length > header->stringPoolSize)
+			{
+				return {};
+			}
+			return { pool + offset, length };
+		}
+	};
+
+	typedef FileView<RecordEntry> IntermediateFile;
+	typedef FileView<LabelEntry> SymbolFile;
+
+	void collectLabels(const assembler::SymbolTable& symbolTable, std::vector<LabelEntry>& entries, StringPool& pool)
+	{
+		entries.reserve(symbolTable.size());
+		for (auto& label : symbolTable.labels)
+		{
+			LabelEntry entry = {};
+			entry.nameOffset = pool.add(label.token.value);
+			entry.nameLength = static_cast<uint32_t>(label.token.value.size());
+			entry.type = static_cast<uint8_t>(label.labelType);
+			entry.value = label.labelValue;
+			entries.push_back(entry);
+		}
+	}
+
+	void serializeSymbolTable(const assembler::SymbolTable& symbolTable, std::string& bytes)
+	{
+		std::vector<LabelEntry> entries;
+		StringPool pool;
+
+		collectLabels(symbolTable, entries, pool);
+		serialize(SYMBOLTABLE_MAGIC, entries, pool, bytes);
+	}
+
+	// label names are interned, the file may be closed afterwards
+	void loadSymbolTable(const SymbolFile& file, assembler::SymbolTable& symbolTable)
+	{
+		symbolTable.reserve(symbolTable.size() + file.size());
+
+		for (size_t i = 0; i < file.size(); i++)
+		{
+			const LabelEntry& entry = file[i];
+			tokenizer::Token name = { tokenizer::TokenType::TK_SYMBOL, file.string(entry.nameOffset, entry.nameLength) };
+
+			symbolTable.define(name, entry.value, static_cast<assembler::OperandType>(entry.type));
+		}
+	}
+
+	// symbol table together with its hash index, layout : header | labels | slots |
+	// string pool. reserved[0] and reserved[1] hold the offset and count of the slots
+	void serializeSnapshot(const assembler::SymbolTable& symbolTable, std::string& bytes)
+	{
+		std::vector<LabelEntry> entries;
+		StringPool pool;
+
+		collectLabels(symbolTable, entries, pool);
+		serialize(SNAPSHOT_MAGIC, entries, pool, bytes);
+
+		// slots go in between the entries and the string pool
+		size_t slotBytes = symbolTable.slots.size() * sizeof(SlotEntry);
+		FileHeader* header = reinterpret_cast<FileHeader*>(&bytes[0]);
+		header->reserved[0] = header->stringPoolOffset;
+		header->reserved[1] = static_cast<uint32_t>(symbolTable.slots.size());
+		header->stringPoolOffset = static_cast<uint32_t>(header->stringPoolOffset + slotBytes);
+		bytes.insert(header->reserved[0], reinterpret_cast<const char*>(symbolTable.slots.data()), slotBytes);
+	}
+
+	struct SnapshotFile : FileView<LabelEntry>
+	{
+		const SlotEntry* slots = nullptr;
+		size_t slotCount = 0;
+
+		bool open(const std::string& path)
+		{
+			return FileView<LabelEntry>::open(path, SNAPSHOT_MAGIC) && validateSlots();
+		}
+
+		bool open(std::string_view bytes)
+		{
+			return FileView<LabelEntry>::open(bytes, SNAPSHOT_MAGIC) && validateSlots();
+		}
+
+		// a power of two of slots, each empty or naming an entry
+		bool validateSlots()
+		{
+			uint64_t offset = header->reserved[0];
+			slotCount = header->reserved[1];
+			if (offset % alignof(SlotEntry) != 0 || offset + slotCount * sizeof(SlotEntry) > buffer.size ||
+				(slotCount & (slotCount - 1)) != 0 || (slotCount == 0 && size() != 0) || slotCount < size())
+			{
+				return false;
+			}
+
+			slots = reinterpret_cast<const SlotEntry*>(buffer.data + offset);
+			for (size_t i = 0; i < slotCount; i++)
+			{
+				if (slots[i].index != assembler::SymbolTable::EMPTY_SLOT && slots[i].index >= size())
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	// takes the index over as it is, nothing is hashed. label names view the file
+	void loadSnapshot(const SnapshotFile& file, assembler::SymbolTable& symbolTable)
+	{
+		symbolTable.clear();
+		symbolTable.labels.reserve(file.size());
+		for (size_t i = 0; i < file.size(); i++)
+		{
+			const LabelEntry& entry = file[i];
+			tokenizer::Token name = { tokenizer::TokenType::TK_SYMBOL, file.string(entry.nameOffset, entry.nameLength) };
+
+			symbolTable.labels.push_back({ name, static_cast<assembler::OperandType>(entry.type), entry.value });
+		}
+
+		symbolTable.slots.resize(file.slotCount);
+		memcpy(symbolTable.slots.data(), file.slots, file.slotCount * sizeof(SlotEntry));
+	}
+
+	void serializeObject(const std::vector<unsigned char>& code, const std::vector<SymbolEntry>& symbols, const std::vector<RelocationEntry>& relocations, const StringPool& pool, std::string& bytes)
+	{
+		ObjectHeader header = {};
+		memcpy(header.magic, OBJECT_MAGIC, 4);
+		header.version = FORMAT_VERSION;
+		header.symbolOffset = sizeof(ObjectHeader);
+		header.symbolCount = static_cast<uint32_t>(symbols.size());
+		header.relocationOffset = static_cast<uint32_t>(header.symbolOffset + symbols.size() * sizeof(SymbolEntry));
+		header.relocationCount = static_cast<uint32_t>(relocations.size());
+		header.codeOffset = static_cast<uint32_t>(header.relocationOffset + relocations.size() * sizeof(RelocationEntry));
+		header.codeSize = static_cast<uint32_t>(code.size());
+		header.stringPoolOffset = header.codeOffset + header.codeSize;
+		header.stringPoolSize = static_cast<uint32_t>(pool.data.size());
+
+		bytes.clear();
+		bytes.reserve(header.stringPoolOffset + header.stringPoolSize);
+		bytes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		bytes.append(reinterpret_cast<const char*>(symbols.data()), symbols.size() * sizeof(SymbolEntry));
+		bytes.append(reinterpret_cast<const char*>(relocations.data()), relocations.size() * sizeof(RelocationEntry));
+		bytes.append(reinterpret_cast<const char*>(code.data()), code.size());
+		bytes.append(pool.data);
+	}
+
+	// validated in place view of a mapped object file
+	struct ObjectFile
+	{
+		utils::SourceBuffer buffer;
+		const ObjectHeader* header = nullptr;
+		const SymbolEntry* symbols = nullptr;
+		const RelocationEntry* relocations = nullptr;
+		const unsigned char* code = nullptr;
+		const char* pool = nullptr;
+
+		bool open(const std::string& path)
+		{
+			if (!buffer.map(path))
+			{
+				return false;
+			}
+			return validate();
+		}
+
+		// every section in bounds, every relocation inside the code and naming an import
+		bool validate()
+		{
+			header = nullptr;
+
+			if (buffer.size < sizeof(ObjectHeader))
+			{
+				return false;
+			}
+
+			const ObjectHeader* _header = reinterpret_cast<const ObjectHeader*>(buffer.data);
+			if (memcmp(_header->magic, OBJECT_MAGIC, 4) != 0 || _header->version != FORMAT_VERSION)
+			{
+				return false;
+			}
+			if (_header->symbolOffset % alignof(SymbolEntry) != 0 || _header->relocationOffset % alignof(RelocationEntry) != 0 ||
+				static_cast<uint64_t>(_header->symbolOffset) + static_cast<uint64_t>(_header->symbolCount) * sizeof(SymbolEntry) > buffer.size ||
+				static_cast<uint64_t>(_header->relocationOffset) + static_cast<uint64_t>(_header->relocationCount) * sizeof(RelocationEntry) > buffer.size ||
+				static_cast<uint64_t>(_header->codeOffset) + _header->codeSize > buffer.size ||
+				static_cast<uint64_t>(_header->stringPoolOffset) + _header->stringPoolSize > buffer.size)
+			{
+				return false;
+			}
+
+			symbols = reinterpret_cast<const SymbolEntry*>(buffer.data + _header->symbolOffset);
+			relocations = reinterpret_cast<const RelocationEntry*>(buffer.data + _header->relocationOffset);
+			code = reinterpret_cast<const unsigned char*>(buffer.data + _header->codeOffset);
+			pool = buffer.data + _header->stringPoolOffset;
+
+			for (size_t i = 0; i < _header->relocationCount; i++)
+			{
+				const RelocationEntry& relocation = relocations[i];
+				uint64_t size = relocation.type == static_cast<uint8_t>(assembler::OperandType::OT_ADDRESS) ? 2 : 1;
+				if (static_cast<uint64_t>(relocation.offset) + size > _header->codeSize ||
+					(relocation.symbol != NO_SYMBOL && (relocation.symbol >= _header->symbolCount || symbols[relocation.symbol].binding != static_cast<uint8_t>(SymbolBinding::SB_IMPORT))))
+				{
+					return false;
+				}
+			}
+
+			header = _header;
+			return true;
+		}
+
+		size_t symbolCount() const
+		{
+			return header ? header->symbolCount : 0;
+		}
+
+		size_t relocationCount() const
+		{
+			return header ? header->relocationCount : 0;
+		}
+
+		size_t codeSize() const
+		{
+			return header ? header->codeSize : 0;
+		}
+
+		// out of range strings read as empty
+		std::string_view string(uint32_t offset, uint32_t length) const
+		{
+			if (static_cast<uint64_t>(offset) + length > header->stringPoolSize)
+			{
+				return {};
+			}
+			return { pool + offset, length };
+		}
+
+		std::string_view name(const SymbolEntry& symbol) const
+		{
+			return string(symbol.nameOffset, symbol.nameLength);
+		}
+	};
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "diagnostics.h"
+#include "passes.h"
+#include "semantics.h"
+#include "optimizer.h"
+
+namespace assembler
+{
+	// straight line run of records, entered at the top only
+	struct Block
+	{
+		// records [first, last)
+		uint32_t first;
+		uint32_t last;
+		// block the jump at the end goes to, -1 if it ends in none
+		int64_t target;
+		// execution may go on with the next record
+		bool fallsThrough;
+		bool reachable;
+	};
+
+	// splits the records into basic blocks at labels and after jumps and HLT, drops the
+	// blocks no path from address 0 reaches and the definitions nothing references, and
+	// lays the rest out so a JMP to the block placed next becomes a fallthrough
+	struct FlowGraph
+	{
+		std::vector<Block> blocks;
+		// block starting at a record, one past the last record included
+		std::vector<int64_t> blockAt;
+		// record a location label stands in front of, -1 for other symbols
+		std::vector<int64_t> labelRecords;
+		std::vector<char> boundaries;
+		std::vector<char> locationLabels;
+		std::vector<size_t> worklist;
+		// blocks in their new order, and whether the JMP ending one is dropped
+		std::vector<size_t> order;
+		std::vector<char> placed;
+		std::vector<char> dropJump;
+
+		bool run(Intermediate& intermediate, OptimizationReport& report, utils::Diagnostics& diagnostics);
+
+	private:
+		bool split(const Intermediate& intermediate);
+		void markReachable();
+		void layout();
+		void rebuild(Intermediate& intermediate, OptimizationReport& report);
+	};
+
+	// false if code is addressed other than by a jump to a label, the layout is pinned then
+	bool FlowGraph::split(const Intermediate& intermediate)
+	{
+		const std::pmr::vector<Record>& records = intermediate.records;
+		const SymbolTable& symbolTable = intermediate.symbolTable;
+
+		markLabels(intermediate, boundaries, locationLabels);
+		if (!jumpsTargetLabels(intermediate, locationLabels) || codeUsedAsData(intermediate, locationLabels))
+		{
+			return false;
+		}
+
+		labelRecords.assign(symbolTable.size(), -1);
+		for (auto& position : intermediate.labelPositions)
+		{
+			labelRecords[position.label] = position.record;
+		}
+
+		blocks.clear();
+		blockAt.assign(records.size() + 1, -1);
+		for (size_t record = 0; record < records.size(); record++)
+		{
+			isa::Semantic semantic = isa::semanticOf(recordOperation(records[record]));
+			int64_t label = operandLabel(symbolTable, records[record]);
+
+			if (blocks.empty() || boundaries[record] || !blocks.back().fallsThrough || blocks.back().target >= 0)
+			{
+				blockAt[record] = static_cast<int64_t>(blocks.size());
+				blocks.push_back({ static_cast<uint32_t>(record), static_cast<uint32_t>(record), -1, true, false });
+			}
+
+			Block& block = blocks.back();
+			block.last = static_cast<uint32_t>(record + 1);
+			if (isa::isJump(semantic))
+			{
+				// resolved to a block once every block exists
+				block.target = label;
+			}
+			block.fallsThrough = semantic != isa::SM_JMP && semantic != isa::SM_HLT;
+		}
+		blockAt[records.size()] = static_cast<int64_t>(blocks.size());
+
+		for (auto& block : blocks)
+		{
+			if (block.target >= 0)
+			{
+				block.target = blockAt[labelRecords[block.target]];
+			}
+		}
+		return true;
+	}
+
+	void FlowGraph::markReachable()
+	{
+		worklist.clear();
+		if (!blocks.empty())
+		{
+			blocks[0].reachable = true;
+			worklist.push_back(0);
+		}
+
+		while (!worklist.empty())
+		{
+			size_t current = worklist.back();
+			worklist.pop_back();
+
+			// a target past the last block is the end of the code
+			int64_t successors[2] = { blocks[current].fallsThrough ? static_cast<int64_t>(current + 1) : -1, blocks[current].target };
+			for (int64_t successor : successors)
+			{
+				if (successor >= 0 && successor < static_cast<int64_t>(blocks.size()) && !blocks[successor].reachable)
+				{
+					blocks[successor].reachable = true;
+					worklist.push_back(successor);
+				}
+			}
+		}
+	}
+
+	// chains of blocks joined by fallthroughs stay together. the chain at address 0 comes
+	// first, the one running off the end of the code last, and a chain ending in a JMP
+	// is followed by the chain it jumps to when that one is still free
+	void FlowGraph::layout()
+	{
+		order.clear();
+		placed.assign(blocks.size(), 0);
+		dropJump.assign(blocks.size(), 0);
+
+		auto isHead = [&](size_t block)
+		{
+			return blocks[block].reachable && (block == 0 || !blocks[block - 1].reachable || !blocks[block - 1].fallsThrough);
+		};
+
+		// head of the chain that runs off the end, it has to stay last
+		int64_t lastHead = -1;
+		if (!blocks.empty() && blocks.back().reachable && blocks.back().fallsThrough)
+		{
+			lastHead = static_cast<int64_t>(blocks.size()) - 1;
+			while (!isHead(lastHead))
+			{
+				lastHead--;
+			}
+		}
+
+		size_t heads = 0;
+		for (size_t block = 0; block < blocks.size(); block++)
+		{
+			heads += isHead(block);
+		}
+
+		size_t scan = 0;
+		int64_t next = blocks.empty() || !blocks[0].reachable ? -1 : 0;
+		while (heads > 0)
+		{
+			if (next < 0)
+			{
+				// the next free chain in source order
+				while (!isHead(scan) || placed[scan] || (static_cast<int64_t>(scan) == lastHead && heads > 1))
+				{
+					scan = (scan + 1) % blocks.size();
+				}
+				next = static_cast<int64_t>(scan);
+			}
+
+			size_t block = static_cast<size_t>(next);
+			for (;;)
+			{
+				order.push_back(block);
+				placed[block] = 1;
+				if (!blocks[block].fallsThrough || block + 1 >= blocks.size())
+				{
+					break;
+				}
+				block++;
+			}
+			heads--;
+
+			// a JMP into a free chain head becomes a fallthrough
+			int64_t target = blocks[block].target;
+			next = -1;
+			if (!blocks[block].fallsThrough && target >= 0 && target < static_cast<int64_t>(blocks.size()) &&
+				!placed[target] && isHead(target) && (target != lastHead || heads == 1))
+			{
+				dropJump[block] = 1;
+				next = target;
+			}
+		}
+	}
+
+	void FlowGraph::rebuild(Intermediate& intermediate, OptimizationReport& report)
+	{
+		std::pmr::vector<Record>& records = intermediate.records;
+		SymbolTable& symbolTable = intermediate.symbolTable;
+
+		// new record index of every block, one past the last record included
+		std::vector<int64_t> moved(blocks.size() + 1, -1);
+		std::pmr::vector<Record> rewritten(records.get_allocator());
+		rewritten.reserve(records.size());
+
+		for (size_t block : order)
+		{
+			moved[block] = static_cast<int64_t>(rewritten.size());
+			uint32_t last = blocks[block].last - dropJump[block];
+			rewritten.insert(rewritten.end(), records.begin() + blocks[block].first, records.begin() + last);
+			report.jumpsRemoved += dropJump[block];
+		}
+		moved[blocks.size()] = static_cast<int64_t>(rewritten.size());
+
+		for (auto& block : blocks)
+		{
+			report.blocksRemoved += !block.reachable;
+		}
+
+		// symbols the remaining code references
+		std::vector<char> keep(symbolTable.size(), 0);
+		for (auto& record : rewritten)
+		{
+			int64_t label = operandLabel(symbolTable, record);
+			if (label >= 0)
+			{
+				keep[label] = 1;
+			}
+		}
+
+		// location labels stay with their block, or go with it
+		std::vector<int64_t> labelMoved(symbolTable.size(), -1);
+		for (auto& position : intermediate.labelPositions)
+		{
+			labelMoved[position.label] = moved[blockAt[position.record]];
+			keep[position.label] = labelMoved[position.label] >= 0;
+		}
+
+		std::pmr::vector<Label> labels(symbolTable.labels.get_allocator());
+		std::pmr::vector<const SymbolTable*> layers(symbolTable.layers.begin(), symbolTable.layers.end(), symbolTable.layers.get_allocator());
+		labels.swap(symbolTable.labels);
+		symbolTable.clear();
+		symbolTable.layers = layers;
+		intermediate.labelPositions.clear();
+
+		for (size_t label = 0; label < labels.size(); label++)
+		{
+			if (!keep[label])
+			{
+				report.definitionsRemoved += labelRecords[label] < 0;
+				continue;
+			}
+
+			symbolTable.define(labels[label].token, labels[label].labelValue, labels[label].labelType);
+			if (labelRecords[label] >= 0)
+			{
+				intermediate.labelPositions.push_back({ static_cast<uint32_t>(symbolTable.size() - 1), static_cast<uint32_t>(labelMoved[label]) });
+			}
+		}
+
+		int64_t oldBytes;
+		int64_t oldCycles;
+		int64_t newBytes;
+		int64_t newCycles;
+		measure(records, oldBytes, oldCycles);
+		measure(rewritten, newBytes, newCycles);
+		report.bytesSaved += oldBytes - newBytes;
+		report.cyclesSaved += oldCycles - newCycles;
+
+		records.swap(rewritten);
+		placeLabels(intermediate);
+	}
+
+	// adds to report, returns true if the records changed. dropped code is assembled
+	// into a scratch buffer first, so its errors are still reported
+	bool FlowGraph::run(Intermediate& intermediate, OptimizationReport& report, utils::Diagnostics& diagnostics)
+	{
+		if (!split(intermediate))
+		{
+			report.skipped = true;
+			return false;
+		}
+
+		markReachable();
+		layout();
+
+		std::vector<unsigned char> scratch;
+		for (auto& block : blocks)
+		{
+			for (uint32_t record = block.first; record < block.last && !block.reachable; record++)
+			{
+				const Record& _record = intermediate.records[record];
+				assembleInstruction(recordOperation(_record), _record, intermediate.symbolTable, scratch, diagnostics);
+			}
+		}
+
+		uint64_t removed = report.blocksRemoved + report.jumpsRemoved + report.definitionsRemoved;
+		rebuild(intermediate, report);
+		return report.blocksRemoved + report.jumpsRemoved + report.definitionsRemoved != removed;
+	}
+}
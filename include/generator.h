@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "passes.h"
+
+// writes valid programs of a configurable shape, the same profile and seed always
+// give the same source
+namespace generator
+{
+	struct Profile
+	{
+		uint64_t seed = 1;
+		// every line holds a definition, a label or an instruction
+		size_t lines = 10000;
+		size_t definitions = 100;
+		size_t labels = 1000;
+		// share of the = definitions that define a literal instead of an address
+		double literalDefinitions = 0.5;
+		// share of symbol operands whose symbol is defined further down
+		double forwardReferences = 0.5;
+		// operand mix of instructions taking an operand, $addr or %lit versus a symbol
+		double rawOperands = 0.3;
+		double symbolOperands = 0.7;
+		// symbol names are padded with underscores to at least this length
+		size_t nameLength = 0;
+		// relative weight of every mnemonic, indexed like assembler::OperationTable
+		std::vector<double> mnemonicWeights = std::vector<double>(assembler::OperationCount, 1.0);
+	};
+
+	// splitmix64, fully specified unlike the standard distributions
+	struct Random
+	{
+		uint64_t state;
+
+		uint64_t next()
+		{
+			uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		// in [0, count)
+		size_t below(size_t count)
+		{
+			return static_cast<size_t>(next() % count);
+		}
+
+		// in [0, 1)
+		double unit()
+		{
+			return (next() >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		bool chance(double probability)
+		{
+			return unit() < probability;
+		}
+	};
+
+	enum class LineKind : unsigned char
+	{
+		LK_ADDRESS_DEFINITION,
+		LK_LITERAL_DEFINITION,
+		LK_LABEL,
+		LK_INSTRUCTION
+	};
+
+	void appendHex(std::string& source, uint64_t value, int digits)
+	{
+		static const char HEX_DIGITS[] = "0123456789ABCDEF";
+		for (int i = digits - 1; i >= 0; i--)
+		{
+			source += HEX_DIGITS[(value >> (i * 4)) & 0xF];
+		}
+	}
+
+	// prefix and number, padded with underscores to length
+	void appendName(std::string& source, char prefix, size_t number, size_t length)
+	{
+		size_t start = source.size();
+		source += prefix;
+		source += std::to_string(number);
+		if (source.size() - start < length)
+		{
+			source.append(length - (source.size() - start), '_');
+		}
+	}
+
+	// index into weights, drawn by weight
+	size_t pickWeighted(Random& random, const std::vector<double>& weights, double total)
+	{
+		double point = random.unit() * total;
+		for (size_t i = 0; i < weights.size(); i++)
+		{
+			if (point < weights[i])
+			{
+				return i;
+			}
+			point -= weights[i];
+		}
+		return weights.size() - 1;
+	}
+
+	// returns false if the profile cannot be satisfied
+	bool generate(const Profile& profile, std::string& source)
+	{
+		if (profile.definitions + profile.labels > profile.lines || profile.mnemonicWeights.size() != assembler::OperationCount)
+		{
+			return false;
+		}
+
+		double totalWeight = 0;
+		for (double weight : profile.mnemonicWeights)
+		{
+			totalWeight += weight;
+		}
+		if (totalWeight <= 0)
+		{
+			return false;
+		}
+
+		Random random = { profile.seed };
+
+		// order of the lines, shuffled with the same generator
+		std::vector<LineKind> kinds;
+		kinds.reserve(profile.lines);
+		for (size_t i = 0; i < profile.definitions; i++)
+		{
+			kinds.push_back(random.chance(profile.literalDefinitions) ? LineKind::LK_LITERAL_DEFINITION : LineKind::LK_ADDRESS_DEFINITION);
+		}
+		kinds.resize(profile.definitions + profile.labels, LineKind::LK_LABEL);
+		kinds.resize(profile.lines, LineKind::LK_INSTRUCTION);
+		for (size_t i = kinds.size(); i > 1; i--)
+		{
+			std::swap(kinds[i - 1], kinds[random.below(i)]);
+		}
+
+		// symbols are numbered in source order per operand type, labels and address
+		// definitions both name addresses
+		size_t addressSymbols = 0;
+		size_t literalSymbols = 0;
+		for (LineKind kind : kinds)
+		{
+			if (kind == LineKind::LK_LITERAL_DEFINITION)
+			{
+				literalSymbols++;
+			}
+			else if (kind != LineKind::LK_INSTRUCTION)
+			{
+				addressSymbols++;
+			}
+		}
+
+		source.clear();
+		source.reserve(profile.lines * 12);
+
+		size_t addressDefined = 0;
+		size_t literalDefined = 0;
+		double operandTotal = profile.rawOperands + profile.symbolOperands;
+
+		for (LineKind kind : kinds)
+		{
+			switch (kind)
+			{
+			case LineKind::LK_ADDRESS_DEFINITION:
+				appendName(source, 'a', addressDefined++, profile.nameLength);
+				source += "\t=\t$";
+				appendHex(source, random.next(), 4);
+				break;
+			case LineKind::LK_LITERAL_DEFINITION:
+				appendName(source, 'v', literalDefined++, profile.nameLength);
+				source += "\t=\t%";
+				appendHex(source, random.next(), 2);
+				break;
+			case LineKind::LK_LABEL:
+				appendName(source, 'a', addressDefined++, profile.nameLength);
+				source += ':';
+				break;
+			case LineKind::LK_INSTRUCTION:
+				const assembler::Operation& operation = assembler::OperationTable[pickWeighted(random, profile.mnemonicWeights, totalWeight)];
+
+				source += '\t';
+				source += operation.mnemonic;
+
+				if (operation.operandType == assembler::OperandType::OT_NONE)
+				{
+					break;
+				}
+				source += ", ";
+
+				bool literal = operation.operandType == assembler::OperandType::OT_LITERAL;
+				size_t defined = literal ? literalDefined : addressDefined;
+				size_t total = literal ? literalSymbols : addressSymbols;
+
+				bool symbol = operandTotal > 0 && total > 0 && random.unit() * operandTotal >= profile.rawOperands;
+				if (!symbol)
+				{
+					source += literal ? '%' : '$';
+					appendHex(source, random.next(), literal ? 2 : 4);
+					break;
+				}
+
+				// forward if asked for and possible, otherwise backward
+				bool forward = random.chance(profile.forwardReferences);
+				if (defined == total)
+				{
+					forward = false;
+				}
+				if (defined == 0)
+				{
+					forward = true;
+				}
+
+				appendName(source, literal ? 'v' : 'a', forward ? defined + random.below(total - defined) : random.below(defined), profile.nameLength);
+				break;
+			}
+			source += '\n';
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "diagnostics.h"
+#include "tokenizer.h"
+#include "sourcebuffer.h"
+#include "symboltable.h"
+#include "fileformat.h"
+#include "passes.h"
+
+// .include, name makes the definitions of another file visible. a definitions file is
+// assembled once per process into a snapshot, which jobs attach to their symbol table
+// as a layer without hashing or inserting. assembler --pch name writes the snapshot to
+// name.pch, later processes map it as long as it is not older than name
+namespace assembler
+{
+	const std::string PRECOMPILED_EXTENSION = ".pch";
+
+	// symbols of one definitions file, names view the snapshot bytes
+	struct Snapshot
+	{
+		fileformat::SnapshotFile file;
+		// a snapshot built in this process instead of mapped
+		std::string bytes;
+		SymbolTable symbolTable;
+		std::filesystem::file_time_type modified;
+	};
+
+	// snapshots by path, shared by every job of the process. a replaced snapshot is
+	// retired instead of freed, running jobs may still have it attached
+	struct IncludeRegistry
+	{
+		std::mutex mutex;
+		std::map<std::string, std::unique_ptr<Snapshot>> snapshots;
+		std::vector<std::unique_ptr<Snapshot>> retired;
+	};
+
+	IncludeRegistry& includeRegistry()
+	{
+		static IncludeRegistry instance;
+		return instance;
+	}
+
+	// assembles a file of = definitions only into snapshot bytes. labels, instructions
+	// and nested includes are errors
+	bool precompileSource(std::string_view source, std::string& bytes, utils::Diagnostics& diagnostics)
+	{
+		tokenizer::TokenStream tokens;
+		std::pmr::vector<Record> records;
+		SymbolTable symbolTable;
+
+		diagnostics.source = source;
+		tokenizer::tokenize(source, tokens, diagnostics);
+
+		for (size_t line = 0; line < tokens.lineCount(); line++)
+		{
+			tokenizer::TokenGroup tokenGroup = tokens.group(line);
+			if (tokenGroup[0].value == INCLUDE_DIRECTIVE)
+			{
+				diagnostics.report(utils::ErrorType::ER_INCLUDE_NOT_DEFINITIONS, tokenGroup.line, tokenGroup[0].value);
+			}
+		}
+
+		collectRecords(tokens, records, [&](const tokenizer::Token& symbol, int value, OperandType type, int64_t line, bool location)
+		{
+			if (location)
+			{
+				diagnostics.report(utils::ErrorType::ER_INCLUDE_NOT_DEFINITIONS, line, symbol.value);
+				return;
+			}
+			appendLabel(symbolTable, symbol, value, type, line, diagnostics);
+		}, diagnostics);
+
+		for (auto& record : records)
+		{
+			diagnostics.report(utils::ErrorType::ER_INCLUDE_NOT_DEFINITIONS, record.tokenGroup.line, record.tokenGroup[0].value);
+		}
+
+		diagnostics.source = {};
+		diagnostics.sort();
+		if (diagnostics.hasErrors())
+		{
+			return false;
+		}
+
+		fileformat::serializeSnapshot(symbolTable, bytes);
+		return true;
+	}
+
+	// writes path.pch, replacing it in one step so concurrent readers see either version
+	bool precompileFile(const std::string& path, std::string& bytes, utils::Diagnostics& diagnostics)
+	{
+		utils::SourceBuffer source;
+		if (!source.map(path))
+		{
+			diagnostics.report(utils::ErrorType::ER_LOADING_FILE, 0);
+			return false;
+		}
+		if (!precompileSource(source.view(), bytes, diagnostics))
+		{
+			return false;
+		}
+
+		std::string temporary = path + PRECOMPILED_EXTENSION + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+		std::error_code error;
+		if (!fileformat::writeBytes(temporary, bytes))
+		{
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+		std::filesystem::rename(temporary, path + PRECOMPILED_EXTENSION, error);
+		if (error)
+		{
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+		return true;
+	}
+
+	// symbols of a definitions file, or of a .pch named directly. without a .pch as new as
+	// the file the snapshot is built in memory, nothing is written next to the file.
+	// null if the file cannot be loaded or is no definitions file
+	const SymbolTable* loadInclude(const std::string& path)
+	{
+		IncludeRegistry& registry = includeRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		std::error_code error;
+		std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+		if (error)
+		{
+			return nullptr;
+		}
+
+		auto found = registry.snapshots.find(path);
+		if (found != registry.snapshots.end() && found->second->modified == modified)
+		{
+			return &found->second->symbolTable;
+		}
+
+		auto snapshot = std::make_unique<Snapshot>();
+		snapshot->modified = modified;
+
+		bool precompiled = path.size() >= PRECOMPILED_EXTENSION.size() && path.compare(path.size() - PRECOMPILED_EXTENSION.size(), std::string::npos, PRECOMPILED_EXTENSION) == 0;
+		if (precompiled)
+		{
+			if (!snapshot->file.open(path))
+			{
+				return nullptr;
+			}
+		}
+		else
+		{
+			std::string snapshotPath = path + PRECOMPILED_EXTENSION;
+			std::filesystem::file_time_type snapshotModified = std::filesystem::last_write_time(snapshotPath, error);
+
+			if (error || snapshotModified < modified || !snapshot->file.open(snapshotPath))
+			{
+				utils::SourceBuffer source;
+				utils::Diagnostics diagnostics;
+				if (!source.map(path) || !precompileSource(source.view(), snapshot->bytes, diagnostics) ||
+					!snapshot->file.open(std::string_view(snapshot->bytes)))
+				{
+					return nullptr;
+				}
+			}
+		}
+
+		fileformat::loadSnapshot(snapshot->file, snapshot->symbolTable);
+
+		const SymbolTable* symbolTable = &snapshot->symbolTable;
+		if (found != registry.snapshots.end())
+		{
+			registry.retired.push_back(std::move(found->second));
+			found->second = std::move(snapshot);
+		}
+		else
+		{
+			registry.snapshots.emplace(path, std::move(snapshot));
+		}
+		return symbolTable;
+	}
+
+	// true if the source may hold an include, its image then depends on other files
+	bool mayInclude(std::string_view source)
+	{
+		return source.find(INCLUDE_DIRECTIVE) != std::string_view::npos;
+	}
+
+	// path of the file an include line names, false for any other line. malformed
+	// lines are reported by the pass
+	bool includePath(const tokenizer::TokenGroup& tokenGroup, const std::string& directory, std::string& path)
+	{
+		if (tokenGroup[0].value != INCLUDE_DIRECTIVE || tokenGroup.size() != 4 ||
+			tokenGroup.type(1) != tokenizer::TokenType::TK_COMMA || tokenGroup.type(2) != tokenizer::TokenType::TK_SYMBOL)
+		{
+			return false;
+		}
+
+		std::string_view name = tokenGroup[2].value;
+		path = directory.empty() ? std::string(name) : (std::filesystem::path(directory) / std::string(name)).string();
+		return true;
+	}
+
+	// files the include lines of tokens name, in source order
+	void listIncludes(const tokenizer::TokenStream& tokens, const std::string& directory, std::vector<std::string>& paths)
+	{
+		std::string path;
+		for (size_t line = 0; line < tokens.lineCount(); line++)
+		{
+			if (includePath(tokens.group(line), directory, path))
+			{
+				paths.push_back(path);
+			}
+		}
+	}
+
+	// attaches the file of every include line in tokens to symbolTable. names an
+	// include brings in must not be defined by the table or an earlier include
+	void attachIncludes(const tokenizer::TokenStream& tokens, SymbolTable& symbolTable, const std::string& directory, utils::Diagnostics& diagnostics)
+	{
+		std::string path;
+		for (size_t line = 0; line < tokens.lineCount(); line++)
+		{
+			tokenizer::TokenGroup tokenGroup = tokens.group(line);
+			if (!includePath(tokenGroup, directory, path))
+			{
+				continue;
+			}
+
+			std::string_view name = tokenGroup[2].value;
+
+			const SymbolTable* layer = loadInclude(path);
+			if (layer == nullptr)
+			{
+				diagnostics.report(utils::ErrorType::ER_LOADING_INCLUDE, tokenGroup.line, name);
+				continue;
+			}
+			if (std::find(symbolTable.layers.begin(), symbolTable.layers.end(), layer) != symbolTable.layers.end())
+			{
+				continue;
+			}
+
+			// usually nothing to check, includes come first
+			bool clash = false;
+			for (auto& label : symbolTable.labels)
+			{
+				clash = clash || layer->find(label.token.value) != nullptr;
+			}
+			for (size_t i = 0; i < layer->labels.size() && !symbolTable.layers.empty(); i++)
+			{
+				clash = clash || symbolTable.findLayered(layer->labels[i].token.value, SymbolTable::hashName(layer->labels[i].token.value)) != nullptr;
+			}
+			if (clash)
+			{
+				diagnostics.report(utils::ErrorType::ER_MULTIPLY_DEFINED_LABELS, tokenGroup.line, name);
+				continue;
+			}
+
+			symbolTable.layers.push_back(layer);
+		}
+	}
+}
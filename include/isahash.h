@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace isa
+{
+	// shared by isagen and the assembler, the generated tables depend on it
+	constexpr uint32_t mnemonicHash(std::string_view mnemonic, uint32_t seed)
+	{
+		uint32_t hash = 2166136261u ^ seed;
+		for (char c : mnemonic)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 16777619u;
+		}
+		return hash ^ (hash >> 15);
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "diagnostics.h"
+#include "stats.h"
+#include "fileformat.h"
+#include "symboltable.h"
+
+// merges relocatable objects into one image. modules are placed one after the other
+// in the order given, the first one at address 0 where execution starts
+namespace linker
+{
+	struct Module
+	{
+		std::string path;
+		fileformat::ObjectFile file;
+		// address of the first code byte in the image
+		uint32_t base = 0;
+		utils::Diagnostics diagnostics;
+	};
+
+	// the module exporting a symbol, ambiguous if more than one does
+	struct Export
+	{
+		uint32_t module;
+		uint32_t symbol;
+		bool ambiguous;
+	};
+
+	// modules has one entry per path, false if any file is no valid object
+	bool load(const std::vector<std::string>& paths, std::vector<Module>& modules)
+	{
+		stats::Timer timer(stats::PH_READ);
+
+		bool loaded = true;
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			modules[i].path = paths[i];
+			if (!modules[i].file.open(paths[i]))
+			{
+				modules[i].diagnostics.report(modules[i].file.buffer.data == nullptr ? utils::ErrorType::ER_LOADING_FILE : utils::ErrorType::ER_INVALID_OBJECT, 0);
+				loaded = false;
+				continue;
+			}
+			stats::add(&stats::Counters::bytesRead, modules[i].file.buffer.size);
+		}
+		return loaded;
+	}
+
+	// value of an exported symbol in the image
+	int exportValue(const Module& module, const fileformat::SymbolEntry& symbol)
+	{
+		bool relative = symbol.binding == static_cast<uint8_t>(fileformat::SymbolBinding::SB_RELATIVE);
+		return relative ? static_cast<int>(module.base) + symbol.value : symbol.value;
+	}
+
+	// lays out the modules, resolves every import against the exports of the other
+	// modules and applies the relocations. errors go to the module they occur in, the
+	// image is incomplete then
+	bool link(std::vector<Module>& modules, std::vector<unsigned char>& image)
+	{
+		image.clear();
+
+		uint64_t size = 0;
+		for (auto& module : modules)
+		{
+			module.base = static_cast<uint32_t>(size);
+			size += module.file.codeSize();
+		}
+		image.reserve(size);
+		for (auto& module : modules)
+		{
+			image.insert(image.end(), module.file.code, module.file.code + module.file.codeSize());
+		}
+
+		// references inside a module were resolved when it was assembled, only
+		// imports look here
+		std::unordered_map<std::string_view, Export> exports;
+		for (size_t i = 0; i < modules.size(); i++)
+		{
+			const fileformat::ObjectFile& file = modules[i].file;
+			for (size_t symbol = 0; symbol < file.symbolCount(); symbol++)
+			{
+				if (file.symbols[symbol].binding == static_cast<uint8_t>(fileformat::SymbolBinding::SB_IMPORT))
+				{
+					continue;
+				}
+
+				auto inserted = exports.emplace(file.name(file.symbols[symbol]), Export{ static_cast<uint32_t>(i), static_cast<uint32_t>(symbol), false });
+				if (!inserted.second && inserted.first->second.module != i)
+				{
+					inserted.first->second.ambiguous = true;
+				}
+			}
+		}
+
+		bool linked = true;
+		for (auto& module : modules)
+		{
+			const fileformat::ObjectFile& file = module.file;
+			for (size_t i = 0; i < file.relocationCount(); i++)
+			{
+				const fileformat::RelocationEntry& relocation = file.relocations[i];
+				unsigned char* operand = image.data() + module.base + relocation.offset;
+				int value;
+
+				if (relocation.symbol == fileformat::NO_SYMBOL)
+				{
+					// a module relative address
+					value = static_cast<int>(module.base) + ((operand[0] << 8) | operand[1]);
+				}
+				else
+				{
+					std::string_view name = file.name(file.symbols[relocation.symbol]);
+					auto found = exports.find(name);
+					if (found == exports.end() || found->second.ambiguous)
+					{
+						module.diagnostics.report(found == exports.end() ? utils::ErrorType::ER_UNDEFINED_SYMBOL : utils::ErrorType::ER_AMBIGUOUS_SYMBOL, relocation.line);
+						linked = false;
+						continue;
+					}
+
+					const Module& definer = modules[found->second.module];
+					const fileformat::SymbolEntry& symbol = definer.file.symbols[found->second.symbol];
+					if (symbol.type != relocation.type)
+					{
+						module.diagnostics.report(utils::ErrorType::ER_INVALID_OPERAND, relocation.line);
+						linked = false;
+						continue;
+					}
+					value = exportValue(definer, symbol);
+				}
+
+				if (relocation.type == static_cast<uint8_t>(assembler::OperandType::OT_ADDRESS))
+				{
+					operand[0] = static_cast<unsigned char>(value >> 8);
+					operand[1] = static_cast<unsigned char>(value);
+				}
+				else
+				{
+					operand[0] = static_cast<unsigned char>(value);
+				}
+			}
+			module.diagnostics.sort();
+		}
+		return linked;
+	}
+
+	// address of every module and exported symbol, for finding code in the image
+	void printMap(std::ostream& os, const std::vector<Module>& modules)
+	{
+		for (auto& module : modules)
+		{
+			os << module.path << "  base " << module.base << "  size " << module.file.codeSize() << '\n';
+			for (size_t symbol = 0; symbol < module.file.symbolCount(); symbol++)
+			{
+				const fileformat::SymbolEntry& entry = module.file.symbols[symbol];
+				if (entry.binding != static_cast<uint8_t>(fileformat::SymbolBinding::SB_IMPORT))
+				{
+					os << "    " << module.file.name(entry) << "  " << exportValue(module, entry) << '\n';
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "diagnostics.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "sourcebuffer.h"
+#include "fileformat.h"
+#include "passes.h"
+#include "include.h"
+#include "assembler.h"
+
+// separate compilation : every module is assembled on its own into a relocatable
+// object, name.o, that the linker merges into the image. location labels are
+// relative to the module, symbols the module does not define are imports
+namespace assembler
+{
+	const std::string OBJECT_EXTENSION = ".o";
+	const std::string DEPFILE_EXTENSION = ".d";
+
+	struct ObjectModule
+	{
+		std::vector<unsigned char> code;
+		std::vector<fileformat::SymbolEntry> symbols;
+		std::vector<fileformat::RelocationEntry> relocations;
+		fileformat::StringPool pool;
+		// files the object is built from, the source first
+		std::vector<std::string> dependencies;
+
+		void clear()
+		{
+			code.clear();
+			symbols.clear();
+			relocations.clear();
+			pool.data.clear();
+			dependencies.clear();
+		}
+
+		uint32_t addSymbol(std::string_view name, OperandType type, fileformat::SymbolBinding binding, int value)
+		{
+			fileformat::SymbolEntry entry = {};
+			entry.nameOffset = pool.add(name);
+			entry.nameLength = static_cast<uint32_t>(name.size());
+			entry.type = static_cast<uint8_t>(type);
+			entry.binding = static_cast<uint8_t>(binding);
+			entry.value = value;
+			symbols.push_back(entry);
+			return static_cast<uint32_t>(symbols.size() - 1);
+		}
+	};
+
+	// the second pass with every label operand the image layout decides left to the
+	// linker. every symbol the module defines is exported, includes are absolute
+	bool assembleModule(std::string_view source, ObjectModule& module, utils::Diagnostics& diagnostics, Workspace& workspace, const Options& options = {})
+	{
+		tokenizer::TokenStream& tokens = workspace.tokens;
+		Intermediate& intermediate = workspace.intermediate;
+		SymbolTable& symbolTable = intermediate.symbolTable;
+
+		workspace.reset();
+		diagnostics.source = source;
+
+		tokenizer::tokenize(source, tokens, diagnostics);
+		listIncludes(tokens, options.includeDirectory, module.dependencies);
+		attachIncludes(tokens, symbolTable, options.includeDirectory, diagnostics);
+		firstPass(tokens, intermediate, diagnostics);
+
+		std::vector<char> relative(symbolTable.size(), 0);
+		for (auto& position : intermediate.labelPositions)
+		{
+			relative[position.label] = 1;
+		}
+		for (size_t label = 0; label < symbolTable.size(); label++)
+		{
+			const Label& _label = symbolTable.labels[label];
+			module.addSymbol(_label.token.value, _label.labelType, relative[label] ? fileformat::SymbolBinding::SB_RELATIVE : fileformat::SymbolBinding::SB_ABSOLUTE, _label.labelValue);
+		}
+
+		{
+			stats::Timer timer(stats::PH_SECOND_PASS);
+
+			std::unordered_map<std::string_view, uint32_t> imports;
+			for (auto& record : intermediate.records)
+			{
+				// validated by the first pass
+				const Operation& operation = *findOperation(record.tokenGroup[0].value);
+
+				if (record.type == RecordType::RT_INS_LABEL)
+				{
+					std::string_view name = record.tokenGroup[2].value;
+					const Label* label = symbolTable.find(name);
+					uint32_t offset = static_cast<uint32_t>(module.code.size() + 1);
+					int32_t line = static_cast<int32_t>(record.tokenGroup.line);
+
+					if (label == nullptr && operation.operandType != OperandType::OT_NONE)
+					{
+						auto import = imports.find(name);
+						if (import == imports.end())
+						{
+							import = imports.emplace(name, module.addSymbol(name, operation.operandType, fileformat::SymbolBinding::SB_IMPORT, 0)).first;
+						}
+						module.relocations.push_back({ offset, import->second, static_cast<uint8_t>(operation.operandType), {}, line });
+						emitPlaceholder(operation, module.code);
+						continue;
+					}
+
+					if (label != nullptr && symbolTable.owns(label) && relative[label - symbolTable.labels.data()] && operation.operandType == label->labelType)
+					{
+						module.relocations.push_back({ offset, fileformat::NO_SYMBOL, static_cast<uint8_t>(operation.operandType), {}, line });
+					}
+				}
+
+				assembleInstruction(operation, record, symbolTable, module.code, diagnostics);
+			}
+		}
+
+		diagnostics.source = {};
+		diagnostics.sort();
+		return !diagnostics.hasErrors();
+	}
+
+	// make rule of the object, a phony rule for every other dependency keeps make going
+	// when one is deleted
+	void serializeDepfile(const std::string& target, const std::vector<std::string>& dependencies, std::string& text)
+	{
+		auto escape = [&](const std::string& path)
+		{
+			for (char c : path)
+			{
+				if (c == ' ' || c == '#')
+				{
+					text += '\\';
+				}
+				text += c == '$' ? "$$" : std::string(1, c);
+			}
+		};
+
+		text.clear();
+		escape(target);
+		text += ':';
+		for (auto& dependency : dependencies)
+		{
+			text += " \\\n  ";
+			escape(dependency);
+		}
+		text += '\n';
+		for (size_t i = 1; i < dependencies.size(); i++)
+		{
+			text += '\n';
+			escape(dependencies[i]);
+			text += ":\n";
+		}
+	}
+
+	// prerequisites of the first rule of a depfile written by serializeDepfile
+	bool readDepfile(const std::string& path, std::vector<std::string>& dependencies)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		std::string word;
+		bool target = true;
+		auto finish = [&]()
+		{
+			if (!word.empty())
+			{
+				dependencies.push_back(word);
+				word.clear();
+			}
+		};
+
+		char c;
+		while (file.get(c))
+		{
+			if (target)
+			{
+				// a colon inside a path is escaped by none of the tools, c:\ is one
+				target = c != ':' || file.peek() == '\\' || file.peek() == '/';
+				continue;
+			}
+			if (c == '\\')
+			{
+				char next = static_cast<char>(file.peek());
+				if (next == ' ' || next == '#')
+				{
+					word += static_cast<char>(file.get());
+					continue;
+				}
+				if (next == '\n' || next == '\r')
+				{
+					// a continued line
+					file.get();
+					if (next == '\r' && file.peek() == '\n')
+					{
+						file.get();
+					}
+					finish();
+					continue;
+				}
+			}
+			if (c == '$' && file.peek() == '$')
+			{
+				word += static_cast<char>(file.get());
+				continue;
+			}
+			if (c == '\n')
+			{
+				break;
+			}
+			if (c == ' ' || c == '\t' || c == '\r')
+			{
+				finish();
+				continue;
+			}
+			word += c;
+		}
+		finish();
+
+		return !target;
+	}
+
+	// true if the object is newer than every file its depfile lists
+	bool objectUpToDate(const std::string& objectPath, const std::string& depfilePath)
+	{
+		std::error_code error;
+		std::filesystem::file_time_type built = std::filesystem::last_write_time(objectPath, error);
+		if (error)
+		{
+			return false;
+		}
+
+		std::vector<std::string> dependencies;
+		if (!readDepfile(depfilePath, dependencies) || dependencies.empty())
+		{
+			return false;
+		}
+		for (auto& dependency : dependencies)
+		{
+			std::filesystem::file_time_type modified = std::filesystem::last_write_time(dependency, error);
+			if (error || modified > built)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// writes path.o and path.d next to the source, replacing the extension
+	bool compileFile(const std::string& path, ObjectModule& module, utils::Diagnostics& diagnostics, Workspace& workspace, const Options& options = {})
+	{
+		module.clear();
+
+		utils::SourceBuffer source;
+		{
+			stats::Timer timer(stats::PH_READ);
+			if (!source.map(path))
+			{
+				diagnostics.report(utils::ErrorType::ER_LOADING_FILE, 0);
+				return false;
+			}
+			stats::add(&stats::Counters::bytesRead, source.size);
+		}
+		if (source.size > UINT32_MAX)
+		{
+			diagnostics.report(utils::ErrorType::ER_LOADING_FILE, 0);
+			return false;
+		}
+
+		Options fileOptions = options;
+		if (fileOptions.includeDirectory.empty())
+		{
+			fileOptions.includeDirectory = std::filesystem::path(path).parent_path().string();
+		}
+
+		module.dependencies.push_back(path);
+		if (!assembleModule(source.view(), module, diagnostics, workspace, fileOptions))
+		{
+			return false;
+		}
+
+		std::string objectPath = std::filesystem::path(path).replace_extension(OBJECT_EXTENSION).string();
+		std::string bytes;
+		std::string depfile;
+
+		fileformat::serializeObject(module.code, module.symbols, module.relocations, module.pool, bytes);
+		serializeDepfile(objectPath, module.dependencies, depfile);
+
+		stats::Timer timer(stats::PH_WRITE);
+		stats::add(&stats::Counters::bytesWritten, bytes.size());
+
+		// the depfile last, an object without one is never taken as current
+		std::error_code error;
+		std::filesystem::path depfilePath = std::filesystem::path(path).replace_extension(DEPFILE_EXTENSION);
+		std::filesystem::remove(depfilePath, error);
+		return fileformat::writeBytes(objectPath, bytes) && fileformat::writeBytes(depfilePath.string(), depfile);
+	}
+}
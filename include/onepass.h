@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "utils.h"
+#include "diagnostics.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "symboltable.h"
+#include "passes.h"
+
+namespace assembler
+{
+	// operand bytes left open until their symbol is defined
+	struct Fixup
+	{
+		// counts released bytes too
+		size_t offset;
+		// index into OnePassAssembler::pending.labels
+		uint32_t label;
+		// fixup number of the previous open operand naming the same symbol
+		uint32_t next;
+		// operand type the instruction expects
+		OperandType type;
+		bool open;
+		int64_t line;
+	};
+
+	// assembles line by line in a single traversal. operands naming a symbol that is
+	// not defined yet are emitted as zeros and patched once the definition shows up
+	struct OnePassAssembler
+	{
+		static constexpr uint32_t NO_FIXUP = 0xFFFFFFFF;
+
+		std::vector<unsigned char>& output;
+		utils::Diagnostics& diagnostics;
+		// output offset of address 0
+		size_t start;
+		// image bytes release already took from the front of output
+		size_t released = 0;
+
+		SymbolTable symbolTable;
+		// symbols referenced before their definition, labelValue indexes chains
+		SymbolTable pending;
+		// number of the last open fixup of every pending symbol, NO_FIXUP once resolved
+		std::pmr::vector<uint32_t> chains;
+		// every forward reference in output order. fixup number n is at n - dropped, the
+		// resolved front is dropped as the stream moves on
+		std::pmr::vector<Fixup> fixups;
+		size_t dropped = 0;
+		// number of the first fixup still open
+		size_t firstOpen = 0;
+
+		OnePassAssembler(std::vector<unsigned char>& _output, utils::Diagnostics& _diagnostics, std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+			output(_output), diagnostics(_diagnostics), start(_output.size()), symbolTable(memory), pending(memory), chains(memory), fixups(memory)
+		{ }
+
+		// bytes emitted from address 0 on, released ones included
+		size_t emitted() const
+		{
+			return output.size() + released - start;
+		}
+
+		int location() const
+		{
+			return static_cast<int>(emitted());
+		}
+
+		Fixup& fixup(size_t number)
+		{
+			return fixups[number - dropped];
+		}
+
+		// bytes from address 0 on that no later line can change anymore
+		size_t committed() const
+		{
+			return firstOpen == dropped + fixups.size() ? emitted() : fixups[firstOpen - dropped].offset - start;
+		}
+
+		// removes committed bytes from the front of the image once the caller wrote them out
+		void release(size_t count)
+		{
+			output.erase(output.begin() + start, output.begin() + start + count);
+			released += count;
+		}
+
+		// a mismatched operand is reported and stays zero
+		void patch(Fixup& fixup, const Label& label)
+		{
+			fixup.open = false;
+
+			if (!validateOperands(fixup.type, label.labelType, fixup.line, pending.labels[fixup.label].token.value, diagnostics))
+			{
+				return;
+			}
+
+			size_t offset = fixup.offset - released;
+			if (label.labelType == OperandType::OT_ADDRESS)
+			{
+				output[offset] = static_cast<unsigned char>(label.labelValue >> 8);
+				output[offset + 1] = static_cast<unsigned char>(label.labelValue);
+			}
+			if (label.labelType == OperandType::OT_LITERAL)
+			{
+				output[offset] = static_cast<unsigned char>(label.labelValue);
+			}
+		}
+
+		// patches every open operand naming a pending symbol
+		void resolve(const Label& waiting, const Label& label)
+		{
+			uint32_t& chain = chains[waiting.labelValue];
+			for (uint32_t number = chain; number != NO_FIXUP; number = fixup(number).next)
+			{
+				patch(fixup(number), label);
+			}
+			chain = NO_FIXUP;
+
+			while (firstOpen < dropped + fixups.size() && !fixup(firstOpen).open)
+			{
+				firstOpen++;
+			}
+			// drop the resolved front once it is most of the vector, fixups stay in place
+			// otherwise
+			if (firstOpen - dropped > fixups.size() / 2 && firstOpen - dropped >= 1024)
+			{
+				fixups.erase(fixups.begin(), fixups.begin() + (firstOpen - dropped));
+				dropped = firstOpen;
+			}
+		}
+
+		void define(const tokenizer::Token& symbol, int value, OperandType type, int64_t line)
+		{
+			appendLabel(symbolTable, symbol, value, type, line, diagnostics);
+
+			// backpatch everything waiting for this symbol
+			const Label* waiting = pending.find(symbol.value);
+			if (waiting != nullptr)
+			{
+				resolve(*waiting, *symbolTable.find(symbol.value));
+			}
+		}
+
+		void reference(const tokenizer::Token& symbol, size_t offset, OperandType type, int64_t line)
+		{
+			const Label* waiting = pending.find(symbol.value);
+			if (waiting == nullptr)
+			{
+				pending.define(symbol, static_cast<int>(chains.size()), OperandType::OT_NONE);
+				chains.push_back(NO_FIXUP);
+				waiting = &pending.labels.back();
+			}
+
+			uint32_t& chain = chains[waiting->labelValue];
+			fixups.push_back({ offset, static_cast<uint32_t>(waiting - pending.labels.data()), chain, type, true, line });
+			chain = static_cast<uint32_t>(dropped + fixups.size() - 1);
+		}
+
+		void feed(const tokenizer::TokenGroup& tokenGroup)
+		{
+			RecordType recordType = findRecordType(tokenGroup);
+
+			switch (recordType)
+			{
+			case RecordType::RT_DEF_ADDRESS:
+				define(tokenGroup[0], utils::parseHex(tokenGroup[3].value), OperandType::OT_ADDRESS, tokenGroup.line);
+				break;
+			case RecordType::RT_DEF_LITERAL:
+				define(tokenGroup[0], utils::parseHex(tokenGroup[3].value), OperandType::OT_LITERAL, tokenGroup.line);
+				break;
+			case RecordType::RT_DEF_LABEL:
+				define(tokenGroup[0], location(), OperandType::OT_ADDRESS, tokenGroup.line);
+				break;
+
+			case RecordType::RT_INCLUDE:
+				// attached to the symbol table before the pass
+				break;
+
+			case RecordType::RT_INS_ADDRESS:
+			case RecordType::RT_INS_LITERAL:
+			case RecordType::RT_INS_LABEL:
+			case RecordType::RT_INS_NONE:
+				const Operation* operation = findOperation(tokenGroup[0].value);
+				//validate operation
+				if (operation == nullptr)
+				{
+					diagnostics.report(utils::ErrorType::ER_UNRECOGNIZED_OPERATION, tokenGroup.line, tokenGroup[0].value);
+					break;
+				}
+
+				// forward reference, leave room for the operand
+				if (recordType == RecordType::RT_INS_LABEL && symbolTable.find(tokenGroup[2].value) == nullptr)
+				{
+					output.push_back(operation->opcode);
+
+					reference(tokenGroup[2], output.size() + released, operation->operandType, tokenGroup.line);
+
+					output.resize(output.size() + operation->wordSize - 1);
+					break;
+				}
+
+				assembleInstruction(*operation, { recordType, tokenGroup }, symbolTable, output, diagnostics);
+				break;
+			}
+		}
+
+		// patches references to symbols that arrived without a definition line, from an
+		// include attached after them
+		void resolvePending()
+		{
+			for (auto& waiting : pending.labels)
+			{
+				const Label* label = chains[waiting.labelValue] == NO_FIXUP ? nullptr : symbolTable.find(waiting.token.value);
+				if (label != nullptr)
+				{
+					resolve(waiting, *label);
+				}
+			}
+		}
+
+		// report every reference that never got a definition, in line order
+		void finish()
+		{
+			for (size_t number = firstOpen; number < dropped + fixups.size(); number++)
+			{
+				const Fixup& open = fixup(number);
+				if (open.open)
+				{
+					diagnostics.report(utils::ErrorType::ER_INVALID_OPERAND, open.line, pending.labels[open.label].token.value);
+				}
+			}
+		}
+	};
+
+	void assembleOnePass(const tokenizer::TokenStream& tokens, SymbolTable& symbolTable, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics)
+	{
+		stats::Timer timer(stats::PH_ONE_PASS);
+		// tables and fixups live in the memory of the caller's table, e.g. the workspace arena
+		OnePassAssembler onePass(output, diagnostics, symbolTable.labels.get_allocator().resource());
+		// includes are attached already
+		onePass.symbolTable.layers = symbolTable.layers;
+
+		for (size_t line = 0; line < tokens.lineCount(); line++)
+		{
+			onePass.feed(tokens.group(line));
+		}
+		onePass.finish();
+
+		symbolTable = std::move(onePass.symbolTable);
+	}
+}
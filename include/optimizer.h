@@ -0,0 +1,452 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "diagnostics.h"
+#include "tokenizer.h"
+#include "passes.h"
+#include "semantics.h"
+
+namespace assembler
+{
+	struct OptimizationReport
+	{
+		uint64_t storeReloads = 0;
+		uint64_t constantFolds = 0;
+		uint64_t nops = 0;
+		uint64_t blocksRemoved = 0;
+		uint64_t jumpsRemoved = 0;
+		uint64_t definitionsRemoved = 0;
+		int64_t bytesSaved = 0;
+		int64_t cyclesSaved = 0;
+		// code addressed other than by jumps to labels pins the layout, nothing is moved then
+		bool skipped = false;
+
+		void add(const OptimizationReport& other)
+		{
+			storeReloads += other.storeReloads;
+			constantFolds += other.constantFolds;
+			nops += other.nops;
+			blocksRemoved += other.blocksRemoved;
+			jumpsRemoved += other.jumpsRemoved;
+			definitionsRemoved += other.definitionsRemoved;
+			bytesSaved += other.bytesSaved;
+			cyclesSaved += other.cyclesSaved;
+			skipped = skipped || other.skipped;
+		}
+
+		friend std::ostream& operator << (std::ostream& os, const OptimizationReport& report)
+		{
+			if (report.skipped)
+			{
+				os << "code is addressed other than by jumps to labels, its layout was kept\n";
+			}
+			os << "store reloads removed " << report.storeReloads << '\n';
+			os << "constants folded " << report.constantFolds << '\n';
+			os << "nops removed " << report.nops << '\n';
+			os << "unreachable blocks removed " << report.blocksRemoved << '\n';
+			os << "jumps turned into fallthroughs " << report.jumpsRemoved << '\n';
+			os << "unused definitions removed " << report.definitionsRemoved << '\n';
+			os << "bytes saved " << report.bytesSaved << '\n';
+			// summed over the instructions, not over an execution
+			os << "cycles saved " << report.cyclesSaved << '\n';
+
+			return os;
+		}
+	};
+
+	const Operation& recordOperation(const Record& record)
+	{
+		// validated by the first pass
+		return *findOperation(record.tokenGroup[0].value);
+	}
+
+	// symbol table index of the symbol operand of a record, -1 if it has none, it is
+	// undefined or it comes from a layer
+	int64_t operandLabel(const SymbolTable& symbolTable, const Record& record)
+	{
+		if (record.type != RecordType::RT_INS_LABEL)
+		{
+			return -1;
+		}
+		const Label* label = symbolTable.find(record.tokenGroup[2].value);
+		return label == nullptr || !symbolTable.owns(label) ? -1 : label - symbolTable.labels.data();
+	}
+
+	// boundaries is set for records with a label in front, one past the last record
+	// included. locationLabels is set for labels bound to the location counter
+	void markLabels(const Intermediate& intermediate, std::vector<char>& boundaries, std::vector<char>& locationLabels)
+	{
+		boundaries.assign(intermediate.records.size() + 1, 0);
+		locationLabels.assign(intermediate.symbolTable.size(), 0);
+		for (auto& position : intermediate.labelPositions)
+		{
+			boundaries[position.record] = 1;
+			locationLabels[position.label] = 1;
+		}
+	}
+
+	// every jump names a label, so moving code keeps every target
+	bool jumpsTargetLabels(const Intermediate& intermediate, const std::vector<char>& locationLabels)
+	{
+		for (auto& record : intermediate.records)
+		{
+			if (!isa::isJump(isa::semanticOf(recordOperation(record))))
+			{
+				continue;
+			}
+
+			int64_t label = operandLabel(intermediate.symbolTable, record);
+			if (label < 0 || !locationLabels[label])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// a location label is the operand of an instruction other than a jump : the code
+	// behind it is read or written as data, so its bytes and address have to stay
+	bool codeUsedAsData(const Intermediate& intermediate, const std::vector<char>& locationLabels)
+	{
+		for (auto& record : intermediate.records)
+		{
+			int64_t label = operandLabel(intermediate.symbolTable, record);
+			if (label >= 0 && locationLabels[label] && !isa::isJump(isa::semanticOf(recordOperation(record))))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void measure(const std::pmr::vector<Record>& records, int64_t& bytes, int64_t& cycles)
+	{
+		bytes = 0;
+		cycles = 0;
+		for (auto& record : records)
+		{
+			const Operation& operation = recordOperation(record);
+			bytes += operation.wordSize;
+			cycles += operation.cycles;
+		}
+	}
+
+	// gives every location label the address of the record it stands in front of
+	void placeLabels(Intermediate& intermediate)
+	{
+		std::vector<int> locations(intermediate.records.size() + 1);
+		for (size_t i = 0; i < intermediate.records.size(); i++)
+		{
+			locations[i + 1] = locations[i] + recordOperation(intermediate.records[i]).wordSize;
+		}
+
+		for (auto& position : intermediate.labelPositions)
+		{
+			intermediate.symbolTable.labels[position.label].labelValue = locations[position.record];
+		}
+	}
+
+	// one entry of the rewritten record stream, a kept record or an instruction line
+	// written by the optimizer
+	struct Replacement
+	{
+		// index into the old records, -1 for text
+		int64_t record;
+		std::string text;
+		int64_t line;
+	};
+
+	struct Peephole;
+
+	// tries to rewrite the records from first on, appends what replaces them and sets
+	// how many were consumed
+	typedef bool (*PatternFunction)(Peephole& peephole, size_t first, std::vector<Replacement>& replacements, size_t& consumed);
+
+	// rewrites the record stream between the passes and moves the labels after it
+	struct Peephole
+	{
+		// rewritten instructions are lexed like source, so records can view them
+		std::string source;
+		tokenizer::TokenStream tokens;
+
+		const Intermediate* intermediate = nullptr;
+		OptimizationReport* report = nullptr;
+		// a label stands in front of the record, nothing may be merged across it
+		std::vector<char> boundaries;
+		// symbol table entries that are labels bound to the location counter
+		std::vector<char> locationLabels;
+
+		const Operation& operation(size_t record) const
+		{
+			return recordOperation(intermediate->records[record]);
+		}
+
+		isa::Semantic semantic(size_t record) const
+		{
+			return isa::semanticOf(operation(record));
+		}
+
+		// value of the operand, false if there is none the optimizer can rely on
+		bool operandValue(size_t record, int& value) const
+		{
+			const Record& _record = intermediate->records[record];
+			const Operation& _operation = operation(record);
+
+			switch (_record.type)
+			{
+			case RecordType::RT_INS_ADDRESS:
+			case RecordType::RT_INS_LITERAL:
+				if ((_record.type == RecordType::RT_INS_ADDRESS) != (_operation.operandType == OperandType::OT_ADDRESS) ||
+					(_record.type == RecordType::RT_INS_LITERAL) != (_operation.operandType == OperandType::OT_LITERAL))
+				{
+					return false;
+				}
+				value = utils::parseHex(_record.tokenGroup[3].value);
+				return true;
+			case RecordType::RT_INS_LABEL:
+			{
+				const Label* label = intermediate->symbolTable.find(_record.tokenGroup[2].value);
+				if (label == nullptr || label->labelType != _operation.operandType)
+				{
+					return false;
+				}
+				value = label->labelValue;
+				return true;
+			}
+			default:
+				return false;
+			}
+		}
+
+		// no flag written from first on is read : the next flag access is a write,
+		// or execution halts, before any jump or label
+		bool flagsDead(size_t first) const
+		{
+			for (size_t record = first; record < intermediate->records.size(); record++)
+			{
+				if (boundaries[record])
+				{
+					return false;
+				}
+
+				isa::Semantic _semantic = semantic(record);
+				if (isa::writesFlags(_semantic) || _semantic == isa::SM_HLT)
+				{
+					return true;
+				}
+				if (isa::readsFlags(_semantic) || isa::isJump(_semantic))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool run(Intermediate& _intermediate, OptimizationReport& _report);
+	};
+
+	std::string literalLine(int value)
+	{
+		char text[16];
+		snprintf(text, sizeof(text), "LDI, %%%02X", value & 0xFF);
+		return text;
+	}
+
+	// STA x, LDA x : the accumulator already holds x
+	bool matchStoreReload(Peephole& peephole, size_t first, std::vector<Replacement>& replacements, size_t& consumed)
+	{
+		size_t second = first + 1;
+		int stored;
+		int loaded;
+
+		if (second >= peephole.intermediate->records.size() || peephole.boundaries[second] ||
+			peephole.semantic(first) != isa::SM_STA || peephole.semantic(second) != isa::SM_LDA ||
+			!peephole.operandValue(first, stored) || !peephole.operandValue(second, loaded) || stored != loaded)
+		{
+			return false;
+		}
+
+		replacements.push_back({ static_cast<int64_t>(first), {}, 0 });
+		consumed = 2;
+		peephole.report->storeReloads++;
+		return true;
+	}
+
+	// LDI a, then ADI and SUI of constants : one LDI of the result. the last ADI or SUI
+	// stays if a later instruction may read the flags it sets
+	bool matchConstantFold(Peephole& peephole, size_t first, std::vector<Replacement>& replacements, size_t& consumed)
+	{
+		const std::pmr::vector<Record>& records = peephole.intermediate->records;
+		int value;
+
+		if (peephole.semantic(first) != isa::SM_LDI || !peephole.operandValue(first, value))
+		{
+			return false;
+		}
+
+		// value before the last operation of the chain, and the end of the chain
+		int previous = value;
+		size_t end = first + 1;
+		for (; end < records.size() && !peephole.boundaries[end]; end++)
+		{
+			isa::Semantic semantic = peephole.semantic(end);
+			int operand;
+			if ((semantic != isa::SM_ADI && semantic != isa::SM_SUI) || !peephole.operandValue(end, operand))
+			{
+				break;
+			}
+			previous = value;
+			value = semantic == isa::SM_ADI ? value + operand : value - operand;
+		}
+
+		size_t chain = end - first - 1;
+		int64_t line = records[first].tokenGroup.line;
+
+		if (chain >= 1 && peephole.flagsDead(end))
+		{
+			replacements.push_back({ -1, literalLine(value), line });
+			peephole.report->constantFolds += chain;
+		}
+		else if (chain >= 2)
+		{
+			replacements.push_back({ -1, literalLine(previous), line });
+			replacements.push_back({ static_cast<int64_t>(end - 1), {}, 0 });
+			peephole.report->constantFolds += chain - 1;
+		}
+		else
+		{
+			return false;
+		}
+
+		consumed = end - first;
+		return true;
+	}
+
+	// labels in front of a NOP move to the next instruction
+	bool matchNop(Peephole& peephole, size_t first, std::vector<Replacement>&, size_t& consumed)
+	{
+		if (peephole.semantic(first) != isa::SM_NOP)
+		{
+			return false;
+		}
+
+		consumed = 1;
+		peephole.report->nops++;
+		return true;
+	}
+
+	// tried in order at every record, the first match wins
+	const PatternFunction PATTERNS[] =
+	{
+		matchStoreReload,
+		matchConstantFold,
+		matchNop
+	};
+
+	// adds to report, returns true if the records changed
+	bool Peephole::run(Intermediate& _intermediate, OptimizationReport& _report)
+	{
+		intermediate = &_intermediate;
+		report = &_report;
+
+		const std::pmr::vector<Record>& records = _intermediate.records;
+
+		markLabels(_intermediate, boundaries, locationLabels);
+		if (!jumpsTargetLabels(_intermediate, locationLabels) || codeUsedAsData(_intermediate, locationLabels))
+		{
+			report->skipped = true;
+			return false;
+		}
+
+		OptimizationReport before = *report;
+
+		// new position of every old record, a removed one maps to its successor
+		std::vector<size_t> moved(records.size() + 1);
+		std::vector<Replacement> replacements;
+		replacements.reserve(records.size());
+
+		size_t record = 0;
+		while (record < records.size())
+		{
+			size_t start = replacements.size();
+			size_t consumed = 0;
+
+			for (auto pattern : PATTERNS)
+			{
+				if (pattern(*this, record, replacements, consumed))
+				{
+					break;
+				}
+			}
+			if (consumed == 0)
+			{
+				replacements.push_back({ static_cast<int64_t>(record), {}, 0 });
+				consumed = 1;
+			}
+
+			for (size_t i = record; i < record + consumed; i++)
+			{
+				moved[i] = start;
+			}
+			record += consumed;
+		}
+		moved[records.size()] = replacements.size();
+
+		if (report->storeReloads == before.storeReloads && report->constantFolds == before.constantFolds && report->nops == before.nops)
+		{
+			return false;
+		}
+
+		// lex the written lines, they are valid by construction
+		source.clear();
+		for (auto& replacement : replacements)
+		{
+			if (replacement.record < 0)
+			{
+				source += replacement.text;
+				source += '\n';
+			}
+		}
+		utils::Diagnostics diagnostics;
+		tokenizer::tokenize(source, tokens, diagnostics);
+
+		std::pmr::vector<Record> rewritten(records.get_allocator());
+		rewritten.reserve(replacements.size());
+		size_t line = 0;
+		for (auto& replacement : replacements)
+		{
+			if (replacement.record >= 0)
+			{
+				rewritten.push_back(records[replacement.record]);
+				continue;
+			}
+			// diagnostics of the second pass point at the replaced source line
+			tokens.lineNumbers[line] = replacement.line;
+			rewritten.push_back({ RecordType::RT_INS_LITERAL, tokens.group(line) });
+			line++;
+		}
+
+		int64_t oldBytes;
+		int64_t oldCycles;
+		int64_t newBytes;
+		int64_t newCycles;
+		measure(records, oldBytes, oldCycles);
+		measure(rewritten, newBytes, newCycles);
+		report->bytesSaved += oldBytes - newBytes;
+		report->cyclesSaved += oldCycles - newCycles;
+
+		for (auto& position : _intermediate.labelPositions)
+		{
+			position.record = static_cast<uint32_t>(moved[position.record]);
+		}
+
+		_intermediate.records.swap(rewritten);
+		placeLabels(_intermediate);
+		return true;
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include "diagnostics.h"
+#include "tokenizer.h"
+#include "passes.h"
+#include "include.h"
+#include "threadpool.h"
+
+namespace assembler
+{
+	struct Definition
+	{
+		tokenizer::Token symbol;
+		int value;
+		OperandType type;
+		int64_t line;
+		// value is relative to the start of the chunk
+		bool location;
+	};
+
+	// part of a source split at line boundaries for parallel assembly
+	struct Chunk
+	{
+		std::string_view source;
+		int64_t firstLine = 1;
+
+		tokenizer::TokenStream tokens;
+		std::pmr::vector<Record> records;
+		std::vector<Definition> definitions;
+		utils::Diagnostics diagnostics;
+
+		// bytes of code, and address of the first one
+		int size = 0;
+		int base = 0;
+	};
+
+	void splitChunks(std::string_view source, size_t count, std::vector<Chunk>& chunks)
+	{
+		chunks.clear();
+		chunks.resize(count);
+
+		size_t begin = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t end = source.size();
+			if (i + 1 < count)
+			{
+				// first line break at or after the even split point
+				end = std::max(begin, source.size() / count * (i + 1));
+				end = source.find('\n', end);
+				end = (end == std::string_view::npos) ? source.size() : end + 1;
+			}
+			chunks[i].source = source.substr(begin, end - begin);
+			begin = end;
+		}
+	}
+
+	// same image as the serial passes : chunks are lexed, classified and emitted on
+	// the pool, only the symbol definitions are merged in source order in between
+	void assembleParallel(std::string_view source, Intermediate& intermediate, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics, const Options& options)
+	{
+		utils::ThreadPool& pool = *options.threadPool;
+
+		size_t count = (source.size() + options.parallelChunkSize - 1) / options.parallelChunkSize;
+		count = std::max<size_t>(1, std::min(count, pool.size() * 4));
+
+		std::vector<Chunk> chunks;
+		splitChunks(source, count, chunks);
+
+		// line numbers of every chunk start
+		std::vector<int64_t> lineCounts(count);
+		pool.parallelFor(count, [&](size_t i)
+		{
+			lineCounts[i] = static_cast<int64_t>(std::count(chunks[i].source.begin(), chunks[i].source.end(), '\n'));
+		});
+		for (size_t i = 1; i < count; i++)
+		{
+			chunks[i].firstLine = chunks[i - 1].firstLine + lineCounts[i - 1];
+		}
+
+		pool.parallelFor(count, [&](size_t i)
+		{
+			Chunk& chunk = chunks[i];
+
+			// spans point into the whole source
+			chunk.diagnostics.source = source;
+			chunk.diagnostics.limit = diagnostics.limit;
+
+			tokenizer::tokenize(chunk.source, chunk.tokens, chunk.diagnostics, chunk.firstLine);
+
+			chunk.size = collectRecords(chunk.tokens, chunk.records, [&](const tokenizer::Token& symbol, int value, OperandType type, int64_t line, bool location)
+			{
+				chunk.definitions.push_back({ symbol, value, type, line, location });
+			}, chunk.diagnostics);
+		});
+
+		// addresses of the chunks, and the symbol table in source order
+		size_t definitionCount = 0;
+		for (size_t i = 1; i < count; i++)
+		{
+			chunks[i].base = chunks[i - 1].base + chunks[i - 1].size;
+		}
+		for (auto& chunk : chunks)
+		{
+			definitionCount += chunk.definitions.size();
+		}
+		intermediate.symbolTable.reserve(definitionCount);
+		// includes of every chunk first, as in the serial passes
+		for (auto& chunk : chunks)
+		{
+			attachIncludes(chunk.tokens, intermediate.symbolTable, options.includeDirectory, diagnostics);
+		}
+		for (auto& chunk : chunks)
+		{
+			for (auto& definition : chunk.definitions)
+			{
+				int value = definition.location ? chunk.base + definition.value : definition.value;
+				appendLabel(intermediate.symbolTable, definition.symbol, value, definition.type, definition.line, diagnostics);
+			}
+		}
+
+		size_t start = output.size();
+		output.resize(start + chunks.back().base + chunks.back().size);
+
+		pool.parallelFor(count, [&](size_t i)
+		{
+			SliceWriter writer = { output.data() + start + chunks[i].base };
+
+			emitRecords(chunks[i].records, intermediate.symbolTable, writer, chunks[i].diagnostics);
+		});
+
+		// merged in source order, the caller sorts them by line
+		for (auto& chunk : chunks)
+		{
+			diagnostics.append(chunk.diagnostics);
+		}
+
+		if (options.dumpIntermediate)
+		{
+			std::ofstream tokenFile(options.dumpPrefix + TOKEN_PATH);
+			for (auto& chunk : chunks)
+			{
+				for (size_t line = 0; line < chunk.tokens.lineCount(); line++)
+				{
+					tokenFile << chunk.tokens.group(line);
+				}
+				intermediate.records.insert(intermediate.records.end(), chunk.records.begin(), chunk.records.end());
+			}
+			tokenFile.close();
+
+			assembler::dumpIntermediate(intermediate, options.dumpPrefix);
+		}
+	}
+}
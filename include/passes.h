@@ -0,0 +1,518 @@
+#pragma once
+
+#include <fstream>
+#include <cstdint>
+#include <string_view>
+#include <cmath>
+#include <memory_resource>
+
+#include "utils.h"
+#include "diagnostics.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "symboltable.h"
+#include "fileformat.h"
+#include "emitter.h"
+#include "cache.h"
+#include "threadpool.h"
+#include "isahash.h"
+
+namespace assembler
+{
+	const std::string INTERMEDIATE_PATH = "intermediate.ime";
+	const std::string SYMBOLTABLE_PATH = "symbolTable.sym";
+	const std::string OBJECT_PATH = "output.out";
+
+	struct Operation
+	{
+		std::string_view mnemonic;
+		unsigned char opcode;
+		unsigned int wordSize;
+		OperandType operandType;
+		// clock cycles on the target
+		unsigned int cycles;
+	};
+}
+
+// OperationTable and its lookup tables, generated from isa/isa.def
+#include "isa_tables.h"
+
+namespace assembler
+{
+	// perfect hash lookup, no allocation and safe to call from several jobs at once
+	const Operation* findOperation(std::string_view mnemonic)
+	{
+		int16_t index = MnemonicHashTable[isa::mnemonicHash(mnemonic, MnemonicHashSeed) & (MnemonicHashSize - 1)];
+		if (index < 0 || OperationTable[index].mnemonic != mnemonic)
+		{
+			return nullptr;
+		}
+		return &OperationTable[index];
+	}
+
+	const Operation* decodeOperation(unsigned char opcode)
+	{
+		int16_t index = OpcodeDecodeTable[opcode];
+		if (index < 0)
+		{
+			return nullptr;
+		}
+		return &OperationTable[index];
+	}
+
+
+	// the lexer decides the shape of a line, every shape is a record type
+	enum class RecordType
+	{
+		RT_DEF_ADDRESS = static_cast<int>(tokenizer::LineShape::LS_DEF_ADDRESS),
+		RT_DEF_LITERAL = static_cast<int>(tokenizer::LineShape::LS_DEF_LITERAL),
+		RT_DEF_LABEL = static_cast<int>(tokenizer::LineShape::LS_DEF_LABEL),
+
+		RT_INS_ADDRESS = static_cast<int>(tokenizer::LineShape::LS_INS_ADDRESS),
+		RT_INS_LITERAL = static_cast<int>(tokenizer::LineShape::LS_INS_LITERAL),
+		RT_INS_LABEL = static_cast<int>(tokenizer::LineShape::LS_INS_LABEL),
+		RT_INS_NONE = static_cast<int>(tokenizer::LineShape::LS_INS_NONE),
+
+		// .include, name : definitions of another file
+		RT_INCLUDE
+	};
+
+	const std::string_view INCLUDE_DIRECTIVE = ".include";
+
+	struct Record
+	{
+		RecordType type;
+		tokenizer::TokenGroup tokenGroup;
+	};
+
+
+	// a label bound to the location counter, and the record it stands in front of
+	struct LabelPosition
+	{
+		uint32_t label;		// index into SymbolTable::labels
+		uint32_t record;
+	};
+
+	struct Intermediate
+	{
+		std::pmr::vector<Record> records;
+		SymbolTable symbolTable;
+		// filled by firstPass only
+		std::pmr::vector<LabelPosition> labelPositions;
+		// bytes of code the records assemble to, optimizing only ever lowers it
+		int64_t size = 0;
+
+		Intermediate() = default;
+
+		explicit Intermediate(std::pmr::memory_resource* memory)
+			: records(memory), symbolTable(memory), labelPositions(memory)
+		{
+		}
+
+		void clear()
+		{
+			size = 0;
+			records.clear();
+			symbolTable.clear();
+			labelPositions.clear();
+		}
+		// before the memory resource is reset
+		void release()
+		{
+			size = 0;
+			utils::release(records);
+			symbolTable.release();
+			utils::release(labelPositions);
+		}
+	};
+
+	struct Options
+	{
+		// write tokens.tkz, intermediate.ime and symbolTable.sym for debugging
+		bool dumpIntermediate = false;
+		// prepended to the dump file names, jobs running side by side need their own
+		std::string dumpPrefix = utils::RES_PATH;
+		// reuse and store finished images, no caching if null
+		cache::Cache* cache = nullptr;
+		// where .include looks for files, assembleFile sets the directory of the source
+		// if empty. the working directory otherwise
+		std::string includeDirectory;
+		// split large sources into chunks assembled on this pool, serial if null
+		utils::ThreadPool* threadPool = nullptr;
+		// bytes of source per chunk, smaller sources are assembled serially
+		size_t parallelChunkSize = 1 << 20;
+		// single traversal with backpatched forward references instead of two passes
+		bool onePass = false;
+		// also run the two pass assembler and compare both images
+		bool crossCheck = false;
+		// peephole optimize the records between the passes, two pass serial path only.
+		// takes precedence over onePass and crossCheck, the command line rejects both
+		bool optimize = false;
+	};
+
+	// the shape the lexer found, an include directive is spelled like an instruction
+	// with a symbol operand. lines that fit no shape never reach the passes
+	RecordType findRecordType(const tokenizer::TokenGroup& tokenGroup)
+	{
+		RecordType recordType = static_cast<RecordType>(tokenGroup.shape);
+		if (recordType == RecordType::RT_INS_LABEL && tokenGroup[0].value == INCLUDE_DIRECTIVE)
+		{
+			return RecordType::RT_INCLUDE;
+		}
+		return recordType;
+	}
+
+	// the first definition of a symbol wins, returns false for later ones
+	bool appendLabel(SymbolTable& symbolTable, const tokenizer::Token& symbol, int labelValue, OperandType type, int64_t line, utils::Diagnostics& diagnostics)
+	{
+		stats::add(&stats::Counters::labels, 1);
+
+		if (!symbolTable.define(symbol, labelValue, type))
+		{
+			diagnostics.report(utils::ErrorType::ER_MULTIPLY_DEFINED_LABELS, line, symbol.value);
+			return false;
+		}
+		return true;
+	}
+
+	// classify every line, keep the instruction records and hand each definition to
+	// define(symbol, value, type, line, location), location is set for labels whose
+	// value is the location counter. returns the size of the code in bytes
+	template <typename Define>
+	int collectRecords(const tokenizer::TokenStream& tokens, std::pmr::vector<Record>& records, Define define, utils::Diagnostics& diagnostics)
+	{
+		stats::Timer timer(stats::PH_FIRST_PASS);
+		size_t firstRecord = records.size();
+		int locationCounter = 0;
+
+		records.reserve(records.size() + tokens.lineCount());
+
+		for (size_t line = 0; line < tokens.lineCount(); line++)
+		{
+			tokenizer::TokenGroup tokenGroup = tokens.group(line);
+			RecordType recordType = findRecordType(tokenGroup);
+
+			switch (recordType)
+			{
+			case RecordType::RT_DEF_ADDRESS:
+				define(tokenGroup[0], utils::parseHex(tokenGroup[3].value), OperandType::OT_ADDRESS, tokenGroup.line, false);
+				break;
+			case RecordType::RT_DEF_LITERAL:
+				define(tokenGroup[0], utils::parseHex(tokenGroup[3].value), OperandType::OT_LITERAL, tokenGroup.line, false);
+				break;
+			case RecordType::RT_DEF_LABEL:
+				define(tokenGroup[0], locationCounter, OperandType::OT_ADDRESS, tokenGroup.line, true);
+				break;
+
+			case RecordType::RT_INCLUDE:
+				// attached to the symbol table before the pass
+				break;
+
+			case RecordType::RT_INS_ADDRESS:
+			case RecordType::RT_INS_LITERAL:
+			case RecordType::RT_INS_LABEL:
+			case RecordType::RT_INS_NONE:
+				const Operation* operation = findOperation(tokenGroup[0].value);
+				//validate operation, the line is left out of the image
+				if (operation == nullptr)
+				{
+					diagnostics.report(utils::ErrorType::ER_UNRECOGNIZED_OPERATION, tokenGroup.line, tokenGroup[0].value);
+					break;
+				}
+
+				locationCounter += operation->wordSize;
+
+				records.push_back({ recordType, tokenGroup });
+				break;
+			}
+		}
+
+		stats::add(&stats::Counters::records, records.size() - firstRecord);
+		return locationCounter;
+	}
+
+	void firstPass(const tokenizer::TokenStream& tokens, Intermediate& intermediate, utils::Diagnostics& diagnostics)
+	{
+		SymbolTable& symbolTable = intermediate.symbolTable;
+
+		intermediate.size = collectRecords(tokens, intermediate.records, [&](const tokenizer::Token& symbol, int value, OperandType type, int64_t line, bool location)
+		{
+			if (appendLabel(symbolTable, symbol, value, type, line, diagnostics) && location)
+			{
+				intermediate.labelPositions.push_back({ static_cast<uint32_t>(symbolTable.size() - 1), static_cast<uint32_t>(intermediate.records.size()) });
+			}
+		}, diagnostics);
+	}
+
+	tokenizer::Token recordOperand(const Record& record)
+	{
+		switch (record.type)
+		{
+		case RecordType::RT_INS_LABEL:
+			return record.tokenGroup[2];
+		case RecordType::RT_INS_ADDRESS:
+		case RecordType::RT_INS_LITERAL:
+			return record.tokenGroup[3];
+		default:
+			return { tokenizer::TokenType::TK_NEWLINE, {} };
+		}
+	}
+
+	void serializeIntermediate(const Intermediate& intermediate, std::string& bytes)
+	{
+		std::vector<fileformat::RecordEntry> entries;
+		fileformat::StringPool pool;
+
+		entries.reserve(intermediate.records.size());
+		for (auto& record : intermediate.records)
+		{
+			std::string_view mnemonic = record.tokenGroup[0].value;
+			std::string_view operand = recordOperand(record).value;
+
+			fileformat::RecordEntry entry = {};
+			entry.type = static_cast<uint8_t>(record.type);
+			entry.line = static_cast<int32_t>(record.tokenGroup.line);
+			entry.mnemonicOffset = pool.add(mnemonic);
+			entry.mnemonicLength = static_cast<uint32_t>(mnemonic.size());
+			entry.operandOffset = pool.add(operand);
+			entry.operandLength = static_cast<uint32_t>(operand.size());
+			entries.push_back(entry);
+		}
+
+		fileformat::serialize(fileformat::INTERMEDIATE_MAGIC, entries, pool, bytes);
+	}
+
+	void dumpIntermediate(const Intermediate& intermediate, const std::string& prefix)
+	{
+		std::string bytes;
+
+		serializeIntermediate(intermediate, bytes);
+		fileformat::writeBytes(prefix + INTERMEDIATE_PATH, bytes);
+
+		fileformat::serializeSymbolTable(intermediate.symbolTable, bytes);
+		fileformat::writeBytes(prefix + SYMBOLTABLE_PATH, bytes);
+	}
+
+	int stringHexToDecimal(std::string string)
+	{
+		int value = 0;
+		int pos = 0;
+		for (char c : string)
+		{
+			int num;
+			switch (c)
+			{
+			case '0':
+				num = 0;
+				break;
+			case '1':
+				num = 1;
+				break;
+			case '2':
+				num = 2;
+				break;
+			case '3':
+				num = 3;
+				break;
+			case '4':
+				num = 4;
+				break;
+			case '5':
+				num = 5;
+				break;
+			case '6':
+				num = 6;
+				break;
+			case '7':
+				num = 7;
+				break;
+			case '8':
+				num = 8;
+				break;
+			case '9':
+				num = 9;
+				break;
+			default:
+				num = 0;
+				break;
+			}
+			value += num * static_cast<int>(pow(16, pos));
+			pos++;
+		}
+		return value;
+	}
+
+	bool findLabel(const SymbolTable& symbolTable, std::string_view symbol, Label& label, int64_t line, utils::Diagnostics& diagnostics)
+	{
+		stats::add(&stats::Counters::symbolLookups, 1);
+
+		// find symbol in symbol table
+		const Label* _label = symbolTable.find(symbol);
+		if (_label != nullptr)
+		{
+			label = *_label;
+			return true;
+		}
+		diagnostics.report(utils::ErrorType::ER_INVALID_OPERAND, line, symbol);
+		return false;
+	}
+
+	// span is the operand the error points at
+	bool validateOperands(OperandType recieved, OperandType expected, int64_t line, std::string_view span, utils::Diagnostics& diagnostics)
+	{
+		//validate operands
+		if (recieved != expected)
+		{
+			diagnostics.report(utils::ErrorType::ER_INVALID_OPERAND, line, span);
+			return false;
+		}
+		return true;
+	}
+
+	// fills a preallocated slice through the same interface as std::vector
+	struct SliceWriter
+	{
+		unsigned char* data;
+
+		void push_back(unsigned char byte)
+		{
+			*data++ = byte;
+		}
+	};
+
+	// stands in for an instruction with a bad operand, keeps every later address and
+	// the slices of the parallel path where they are
+	template <typename Output>
+	void emitPlaceholder(const Operation& operation, Output& output)
+	{
+		output.push_back(operation.opcode);
+		for (unsigned int i = 1; i < operation.wordSize; i++)
+		{
+			output.push_back(0);
+		}
+	}
+
+	template <typename Output>
+	void assembleInstruction(const Operation& operation, const Record& record, const SymbolTable& symbolTable, Output& output, utils::Diagnostics& diagnostics)
+	{
+		std::string_view address;
+
+		switch (record.type)
+		{
+		case RecordType::RT_DEF_ADDRESS:
+		case RecordType::RT_DEF_LITERAL:
+		case RecordType::RT_DEF_LABEL:
+		case RecordType::RT_INCLUDE:
+			// taken in by the first pass, they emit no code
+			break;
+		case RecordType::RT_INS_ADDRESS:
+			
+			if (!validateOperands(operation.operandType, OperandType::OT_ADDRESS, record.tokenGroup.line, record.tokenGroup[3].value, diagnostics))
+			{
+				emitPlaceholder(operation, output);
+				break;
+			}
+
+			output.push_back(operation.opcode);
+
+			unsigned char lowerByte;
+			unsigned char upperByte;
+
+			//get address
+			address = record.tokenGroup[3].value;;
+
+			//get address value in hex
+			lowerByte = utils::parseHex(address.substr(0, 2));
+			upperByte = utils::parseHex(address.substr(2, 2));
+
+			output.push_back(lowerByte);
+			output.push_back(upperByte);
+
+			break;
+		case RecordType::RT_INS_LITERAL:
+
+			if (!validateOperands(operation.operandType, OperandType::OT_LITERAL, record.tokenGroup.line, record.tokenGroup[3].value, diagnostics))
+			{
+				emitPlaceholder(operation, output);
+				break;
+			}
+
+			output.push_back(operation.opcode);
+
+			unsigned char literal;
+
+			//get address
+			address = record.tokenGroup[3].value;;
+
+			//get address value in hex
+			literal = utils::parseHex(address.substr(0, 2));
+
+			output.push_back(literal);
+			break;
+		case RecordType::RT_INS_NONE:
+			
+			if (!validateOperands(operation.operandType, OperandType::OT_NONE, record.tokenGroup.line, record.tokenGroup[0].value, diagnostics))
+			{
+				emitPlaceholder(operation, output);
+				break;
+			}
+
+			output.push_back(operation.opcode);
+			break;
+		case RecordType::RT_INS_LABEL:
+			Label label;
+
+			if (!findLabel(symbolTable, record.tokenGroup[2].value, label, record.tokenGroup.line, diagnostics) ||
+				!validateOperands(operation.operandType, label.labelType, record.tokenGroup.line, record.tokenGroup[2].value, diagnostics))
+			{
+				emitPlaceholder(operation, output);
+				break;
+			}
+
+			output.push_back(operation.opcode);
+
+			if (label.labelType == OperandType::OT_ADDRESS)
+			{
+				//get address
+				unsigned char lowerByte = label.labelValue >> 8;
+				unsigned char upperByte = label.labelValue;
+
+				output.push_back(lowerByte);
+				output.push_back(upperByte);
+				break;
+			}
+
+			if (label.labelType == OperandType::OT_LITERAL)
+			{
+				output.push_back(static_cast<unsigned char>(label.labelValue));
+				break;
+			}
+		}
+	}
+
+	template <typename Output>
+	void emitRecords(const std::pmr::vector<Record>& records, const SymbolTable& symbolTable, Output& output, utils::Diagnostics& diagnostics)
+	{
+		stats::Timer timer(stats::PH_SECOND_PASS);
+
+		for (auto& record : records)
+		{
+			// validated by the first pass
+			const Operation* operation = findOperation(record.tokenGroup[0].value);
+
+			assembleInstruction(*operation, record, symbolTable, output, diagnostics);
+		}
+	}
+
+	void secondPass(const Intermediate& intermediate, std::vector<unsigned char>& output, utils::Diagnostics& diagnostics)
+	{
+		// the image grows without reallocating
+		output.reserve(output.size() + static_cast<size_t>(intermediate.size));
+		emitRecords(intermediate.records, intermediate.symbolTable, output, diagnostics);
+	}
+
+	bool writeObject(const std::vector<unsigned char>& output, const std::string& path = utils::RES_PATH + OBJECT_PATH, emitter::Format format = emitter::Format::OF_RAW)
+	{
+		return emitter::writeImage(output, path, format);
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+#include "passes.h"
+
+// what every instruction does, independent of the opcodes isa.def assigns
+namespace isa
+{
+	enum Semantic : unsigned char
+	{
+		SM_HLT,
+		SM_LDA,
+		SM_LDI,
+		SM_ADD,
+		SM_ADI,
+		SM_SUB,
+		SM_SUI,
+		SM_STA,
+		SM_JMP,
+		SM_JC,
+		SM_JZ,
+		SM_PRT,
+		SM_NOP,
+		SM_INVALID
+	};
+
+	const char* const SEMANTIC_MNEMONICS[SM_INVALID] =
+	{
+		"HLT", "LDA", "LDI", "ADD", "ADI", "SUB", "SUI", "STA", "JMP", "JC", "JZ", "PRT", "NOP"
+	};
+
+	// semantic of every opcode, SM_INVALID for unused ones
+	const unsigned char* semanticTable()
+	{
+		static const auto table = []()
+		{
+			std::vector<unsigned char> semantics(256, SM_INVALID);
+
+			for (auto& operation : assembler::OperationTable)
+			{
+				for (int semantic = 0; semantic < SM_INVALID; semantic++)
+				{
+					if (operation.mnemonic == SEMANTIC_MNEMONICS[semantic])
+					{
+						semantics[operation.opcode] = static_cast<unsigned char>(semantic);
+					}
+				}
+			}
+			return semantics;
+		}();
+
+		return table.data();
+	}
+
+	Semantic semanticOf(const assembler::Operation& operation)
+	{
+		return static_cast<Semantic>(semanticTable()[operation.opcode]);
+	}
+
+	// ADD, ADI, SUB and SUI set carry and zero, JC and JZ read them
+	bool writesFlags(Semantic semantic)
+	{
+		return semantic == SM_ADD || semantic == SM_ADI || semantic == SM_SUB || semantic == SM_SUI;
+	}
+
+	bool readsFlags(Semantic semantic)
+	{
+		return semantic == SM_JC || semantic == SM_JZ;
+	}
+
+	bool isJump(Semantic semantic)
+	{
+		return semantic == SM_JMP || semantic == SM_JC || semantic == SM_JZ;
+	}
+}
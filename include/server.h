@@ -0,0 +1,467 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "diagnostics.h"
+#include "stats.h"
+#include "fileformat.h"
+#include "threadpool.h"
+#include "assembler.h"
+
+// resident assembler answering framed requests on stdin/stdout or a unix domain
+// socket, all fields are little endian
+namespace server
+{
+	const uint16_t PROTOCOL_VERSION = 1;
+	// largest source a request may carry unless the server is told otherwise
+	const size_t DEFAULT_MAX_SOURCE_SIZE = 64 << 20;
+
+	const char REQUEST_MAGIC[4] = { 'A', 'S', 'M', 'Q' };
+	const char RESPONSE_MAGIC[4] = { 'A', 'S', 'M', 'R' };
+
+	enum class Command : uint8_t
+	{
+		CM_ASSEMBLE,
+		// answered, then the server stops
+		CM_SHUTDOWN
+	};
+
+	// request flags
+	const uint8_t FLAG_ONE_PASS = 1;
+
+	enum class Status : uint8_t
+	{
+		ST_OK,
+		// assembled with errors, the diagnostics say which
+		ST_ERRORS,
+		// unreadable request, the connection is closed after the reply
+		ST_BAD_REQUEST,
+		// source above the limit of the server, the connection is closed after the reply
+		ST_TOO_LARGE
+	};
+
+	// request layout : header | source
+	struct RequestHeader
+	{
+		char magic[4];
+		uint16_t version;
+		uint8_t command;		// server::Command
+		uint8_t flags;
+		uint32_t id;			// echoed in the response
+		uint32_t sourceSize;
+	};
+
+	// response layout : header | image | symbol table file | diagnostics
+	struct ResponseHeader
+	{
+		char magic[4];
+		uint16_t version;
+		uint8_t status;			// server::Status
+		uint8_t reserved;
+		uint32_t id;
+		uint32_t imageSize;
+		uint32_t symbolTableSize;
+		uint32_t diagnosticCount;
+		uint32_t errorCount;	// can exceed diagnosticCount
+		uint32_t reserved2;
+	};
+
+	struct DiagnosticEntry
+	{
+		uint16_t code;
+		uint8_t severity;		// utils::Severity
+		uint8_t reserved;
+		int32_t line;
+		int32_t column;
+		uint32_t offset;		// span in the request source
+		uint32_t length;
+		uint32_t reserved2;
+	};
+
+	static_assert(sizeof(RequestHeader) == 16, "RequestHeader layout changed");
+	static_assert(sizeof(ResponseHeader) == 32, "ResponseHeader layout changed");
+	static_assert(sizeof(DiagnosticEntry) == 24, "DiagnosticEntry layout changed");
+
+	// false at the end of the stream or on an error, partial reads are retried
+	bool readBytes(int fd, void* data, size_t size)
+	{
+		char* bytes = static_cast<char*>(data);
+		while (size > 0)
+		{
+#ifdef _WIN32
+			int count = _read(fd, bytes, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+#else
+			ssize_t count = read(fd, bytes, size);
+#endif
+			if (count < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (count <= 0)
+			{
+				return false;
+			}
+			bytes += count;
+			size -= count;
+		}
+		return true;
+	}
+
+	bool writeBytes(int fd, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		while (size > 0)
+		{
+#ifdef _WIN32
+			int count = _write(fd, bytes, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+#else
+			ssize_t count = write(fd, bytes, size);
+#endif
+			if (count < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (count <= 0)
+			{
+				return false;
+			}
+			bytes += count;
+			size -= count;
+		}
+		return true;
+	}
+
+	// state of one connection, reused by every request it serves
+	struct Session
+	{
+		std::string source;
+		std::vector<unsigned char> image;
+		std::string symbolTable;
+		std::string response;
+		utils::Diagnostics diagnostics;
+		assembler::Workspace workspace;
+	};
+
+	void buildResponse(Session& session, const RequestHeader& request, Status status)
+	{
+		const utils::Diagnostics& diagnostics = session.diagnostics;
+
+		ResponseHeader header = {};
+		memcpy(header.magic, RESPONSE_MAGIC, 4);
+		header.version = PROTOCOL_VERSION;
+		header.status = static_cast<uint8_t>(status);
+		header.id = request.id;
+		header.imageSize = static_cast<uint32_t>(session.image.size());
+		header.symbolTableSize = static_cast<uint32_t>(session.symbolTable.size());
+		header.diagnosticCount = static_cast<uint32_t>(diagnostics.entries.size());
+		header.errorCount = static_cast<uint32_t>(diagnostics.errorCount);
+
+		session.response.clear();
+		session.response.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		session.response.append(reinterpret_cast<const char*>(session.image.data()), session.image.size());
+		session.response.append(session.symbolTable);
+
+		for (auto& diagnostic : diagnostics.entries)
+		{
+			DiagnosticEntry entry = {};
+			entry.code = static_cast<uint16_t>(diagnostic.code());
+			entry.severity = static_cast<uint8_t>(diagnostic.severity);
+			entry.line = static_cast<int32_t>(diagnostic.line);
+			entry.column = diagnostic.column;
+			entry.offset = static_cast<uint32_t>(diagnostic.offset);
+			entry.length = static_cast<uint32_t>(diagnostic.length);
+			session.response.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		}
+	}
+
+	// what became of the connection after a request
+	enum class Outcome
+	{
+		OC_SERVED,
+		// ended or unusable, it is closed
+		OC_CLOSED,
+		// answered a shutdown request
+		OC_SHUTDOWN
+	};
+
+	// reads and answers one request. sources above maxSourceSize are refused before
+	// they are read
+	Outcome serveRequest(int input, int output, Session& session, const assembler::Options& options, size_t maxSourceSize)
+	{
+		RequestHeader request;
+		if (!readBytes(input, &request, sizeof(request)))
+		{
+			return Outcome::OC_CLOSED;
+		}
+
+		session.image.clear();
+		session.symbolTable.clear();
+		session.diagnostics.clear();
+
+		if (memcmp(request.magic, REQUEST_MAGIC, 4) != 0 || request.version != PROTOCOL_VERSION || request.command > static_cast<uint8_t>(Command::CM_SHUTDOWN))
+		{
+			buildResponse(session, request, Status::ST_BAD_REQUEST);
+			writeBytes(output, session.response.data(), session.response.size());
+			return Outcome::OC_CLOSED;
+		}
+
+		// the rest of the frame stays unread, the stream cannot be followed anymore
+		if (request.sourceSize > maxSourceSize)
+		{
+			buildResponse(session, request, Status::ST_TOO_LARGE);
+			writeBytes(output, session.response.data(), session.response.size());
+			return Outcome::OC_CLOSED;
+		}
+
+		session.source.resize(request.sourceSize);
+		{
+			stats::Timer timer(stats::PH_READ);
+			if (!readBytes(input, &session.source[0], session.source.size()))
+			{
+				return Outcome::OC_CLOSED;
+			}
+			stats::add(&stats::Counters::bytesRead, session.source.size());
+		}
+
+		if (request.command == static_cast<uint8_t>(Command::CM_SHUTDOWN))
+		{
+			buildResponse(session, request, Status::ST_OK);
+			writeBytes(output, session.response.data(), session.response.size());
+			return Outcome::OC_SHUTDOWN;
+		}
+
+		assembler::Options requestOptions = options;
+		requestOptions.onePass = (request.flags & FLAG_ONE_PASS) != 0;
+		// a one pass request is not optimized, the optimizer needs the records of two
+		requestOptions.optimize = options.optimize && !requestOptions.onePass;
+		requestOptions.crossCheck = false;
+		requestOptions.dumpIntermediate = false;
+		// the reply carries the symbol table, which a cache hit does not rebuild
+		requestOptions.cache = nullptr;
+
+		bool success = assembler::assembleSource(session.source, session.image, session.diagnostics, session.workspace, requestOptions);
+		fileformat::serializeSymbolTable(session.workspace.intermediate.symbolTable, session.symbolTable);
+
+		buildResponse(session, request, success ? Status::ST_OK : Status::ST_ERRORS);
+		if (!writeBytes(output, session.response.data(), session.response.size()))
+		{
+			return Outcome::OC_CLOSED;
+		}
+		return Outcome::OC_SERVED;
+	}
+
+	// serves requests until the stream ends or a shutdown request, returns true
+	// for the latter
+	bool serveConnection(int input, int output, Session& session, const assembler::Options& options, size_t maxSourceSize)
+	{
+		Outcome outcome;
+		do
+		{
+			outcome = serveRequest(input, output, session, options, maxSourceSize);
+		} while (outcome == Outcome::OC_SERVED);
+
+		return outcome == Outcome::OC_SHUTDOWN;
+	}
+
+	int serveStdio(const assembler::Options& options, size_t maxSourceSize = DEFAULT_MAX_SOURCE_SIZE)
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+		int input = _fileno(stdin);
+		int output = _fileno(stdout);
+#else
+		int input = STDIN_FILENO;
+		int output = STDOUT_FILENO;
+#endif
+
+		Session session;
+		serveConnection(input, output, session, options, maxSourceSize);
+		return 0;
+	}
+
+#ifndef _WIN32
+	// a client that stalls in the middle of a request is dropped after this long
+	const int REQUEST_TIMEOUT_SECONDS = 30;
+
+	// idle connections wait in poll on this thread, every request that arrives is
+	// served on the pool and its connection handed back afterwards. an idle client
+	// holds no worker. sessions stay with their worker
+	int serveSocket(const std::string& path, const assembler::Options& options, size_t threadCount, size_t maxSourceSize = DEFAULT_MAX_SOURCE_SIZE)
+	{
+		// a client hanging up must not kill the server
+		signal(SIGPIPE, SIG_IGN);
+
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			return 1;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+		int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+		{
+			return 1;
+		}
+		unlink(path.c_str());
+		if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0)
+		{
+			close(listener);
+			return 1;
+		}
+
+		// workers write a byte to wake up the poll below. neither end blocks, a full pipe
+		// wakes it up as well
+		int wakeup[2];
+		if (pipe(wakeup) != 0)
+		{
+			close(listener);
+			return 1;
+		}
+		fcntl(wakeup[0], F_SETFL, O_NONBLOCK);
+		fcntl(wakeup[1], F_SETFL, O_NONBLOCK);
+
+		utils::ThreadPool pool(threadCount);
+		std::vector<Session> sessions(pool.size());
+		std::atomic<bool> stopping(false);
+
+		// connections waiting for their next request, and those a worker is done with
+		std::vector<int> idle;
+		std::mutex returnedMutex;
+		std::vector<int> returned;
+		std::vector<pollfd> polled;
+
+		// requests already fill the pool
+		assembler::Options connectionOptions = options;
+		connectionOptions.threadPool = nullptr;
+
+		auto wake = [&]()
+		{
+			char byte = 0;
+			while (write(wakeup[1], &byte, 1) < 0 && errno == EINTR)
+			{
+			}
+		};
+
+		while (!stopping)
+		{
+			polled.clear();
+			polled.push_back({ listener, POLLIN, 0 });
+			polled.push_back({ wakeup[0], POLLIN, 0 });
+			for (int connection : idle)
+			{
+				polled.push_back({ connection, POLLIN, 0 });
+			}
+
+			if (poll(polled.data(), polled.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+
+			// a readable connection has a request, or has hung up
+			std::vector<int> waiting;
+			for (size_t i = 2; i < polled.size(); i++)
+			{
+				int connection = polled[i].fd;
+				if (polled[i].revents == 0)
+				{
+					waiting.push_back(connection);
+					continue;
+				}
+
+				pool.submit([&, connection]()
+				{
+					Session& session = sessions[utils::ThreadPool::currentWorker()];
+
+					Outcome outcome = serveRequest(connection, connection, session, connectionOptions, maxSourceSize);
+					if (outcome == Outcome::OC_SERVED)
+					{
+						std::lock_guard<std::mutex> lock(returnedMutex);
+						returned.push_back(connection);
+					}
+					else
+					{
+						close(connection);
+					}
+
+					if (outcome == Outcome::OC_SHUTDOWN)
+					{
+						// requests in flight still get their reply
+						stopping = true;
+					}
+					wake();
+				});
+			}
+			idle.swap(waiting);
+
+			if (polled[1].revents != 0)
+			{
+				char bytes[64];
+				while (read(wakeup[0], bytes, sizeof(bytes)) > 0)
+				{
+				}
+				std::lock_guard<std::mutex> lock(returnedMutex);
+				idle.insert(idle.end(), returned.begin(), returned.end());
+				returned.clear();
+			}
+
+			if (polled[0].revents != 0)
+			{
+				int connection = accept(listener, nullptr, nullptr);
+				if (connection < 0)
+				{
+					if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+					{
+						break;
+					}
+					continue;
+				}
+
+				timeval timeout = { REQUEST_TIMEOUT_SECONDS, 0 };
+				setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+				idle.push_back(connection);
+			}
+		}
+		pool.wait();
+
+		for (int connection : idle)
+		{
+			close(connection);
+		}
+		for (int connection : returned)
+		{
+			close(connection);
+		}
+		close(wakeup[0]);
+		close(wakeup[1]);
+		close(listener);
+		unlink(path.c_str());
+		return 0;
+	}
+#endif
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+	// read-only view of a whole source file, either memory mapped or caller provided
+	struct SourceBuffer
+	{
+		const char* data = nullptr;
+		size_t size = 0;
+		bool mapped = false;
+
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#endif
+
+		SourceBuffer() = default;
+		SourceBuffer(const SourceBuffer&) = delete;
+		SourceBuffer& operator = (const SourceBuffer&) = delete;
+
+		~SourceBuffer()
+		{
+			unmap();
+		}
+
+		// map path into memory, returns false if the file cannot be opened
+		bool map(const std::string& path)
+		{
+			unmap();
+
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+
+			LARGE_INTEGER fileSize;
+			GetFileSizeEx(file, &fileSize);
+			size = static_cast<size_t>(fileSize.QuadPart);
+			mapped = true;
+
+			// empty files cannot be mapped
+			if (size == 0)
+			{
+				data = "";
+				return true;
+			}
+
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL)
+			{
+				unmap();
+				return false;
+			}
+			data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (data == nullptr)
+			{
+				unmap();
+				return false;
+			}
+#else
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return false;
+			}
+
+			struct stat status;
+			if (fstat(fd, &status) != 0)
+			{
+				close(fd);
+				return false;
+			}
+			size = static_cast<size_t>(status.st_size);
+			mapped = true;
+
+			// empty files cannot be mapped
+			if (size == 0)
+			{
+				close(fd);
+				data = "";
+				return true;
+			}
+
+			void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (address == MAP_FAILED)
+			{
+				data = nullptr;
+				size = 0;
+				mapped = false;
+				return false;
+			}
+			madvise(address, size, MADV_SEQUENTIAL);
+			data = static_cast<const char*>(address);
+#endif
+			return true;
+		}
+
+		// use a caller provided buffer, which has to outlive this object
+		void assign(std::string_view buffer)
+		{
+			unmap();
+
+			data = buffer.data();
+			size = buffer.size();
+		}
+
+		void unmap()
+		{
+#ifdef _WIN32
+			if (mapped && size != 0 && data != nullptr)
+			{
+				UnmapViewOfFile(data);
+			}
+			if (mapping != NULL)
+			{
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mapped && size != 0)
+			{
+				munmap(const_cast<char*>(data), size);
+			}
+#endif
+			data = nullptr;
+			size = 0;
+			mapped = false;
+		}
+
+		std::string_view view() const
+		{
+			return { data, size };
+		}
+	};
+}
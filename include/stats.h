@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+// phase timers and counters of every assembly job in the process. everything is a
+// single flag test while switched off
+namespace stats
+{
+	enum Phase
+	{
+		PH_READ,
+		PH_LEX,
+		// whole passes only, a timer per symbol would cost more than the symbol
+		PH_FIRST_PASS,
+		PH_SECOND_PASS,
+		PH_ONE_PASS,
+		PH_WRITE,
+
+		PH_COUNT
+	};
+
+	const char* const PHASE_NAMES[PH_COUNT] =
+	{
+		"read",
+		"lex",
+		"first pass",
+		"second pass",
+		"one pass",
+		"write"
+	};
+
+	struct Counters
+	{
+		uint64_t phaseNanoseconds[PH_COUNT] = {};
+		uint64_t phaseCalls[PH_COUNT] = {};
+
+		uint64_t tokens = 0;
+		uint64_t lines = 0;
+		uint64_t records = 0;
+		uint64_t labels = 0;
+		uint64_t symbolLookups = 0;
+		uint64_t bytesRead = 0;
+		uint64_t bytesWritten = 0;
+
+		void add(const Counters& other)
+		{
+			for (int i = 0; i < PH_COUNT; i++)
+			{
+				phaseNanoseconds[i] += other.phaseNanoseconds[i];
+				phaseCalls[i] += other.phaseCalls[i];
+			}
+			tokens += other.tokens;
+			lines += other.lines;
+			records += other.records;
+			labels += other.labels;
+			symbolLookups += other.symbolLookups;
+			bytesRead += other.bytesRead;
+			bytesWritten += other.bytesWritten;
+		}
+	};
+
+	std::atomic<bool> active(false);
+	// counted by the operator new of the executable, if it replaces it
+	std::atomic<uint64_t> allocations(0);
+	std::atomic<uint64_t> allocatedBytes(0);
+
+	bool enabled()
+	{
+		return active.load(std::memory_order_relaxed);
+	}
+
+	void enable()
+	{
+		active = true;
+	}
+
+	void countAllocation(size_t size)
+	{
+		if (enabled())
+		{
+			allocations.fetch_add(1, std::memory_order_relaxed);
+			allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+		}
+	}
+
+	// counters of every thread that ever counted, threads fold theirs into retired
+	// when they exit
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<Counters*> live;
+		Counters retired;
+	};
+
+	Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+
+	struct ThreadCounters
+	{
+		Counters counters;
+
+		ThreadCounters()
+		{
+			std::lock_guard<std::mutex> lock(registry().mutex);
+			registry().live.push_back(&counters);
+		}
+
+		~ThreadCounters()
+		{
+			Registry& all = registry();
+			std::lock_guard<std::mutex> lock(all.mutex);
+			all.retired.add(counters);
+			all.live.erase(std::find(all.live.begin(), all.live.end(), &counters));
+		}
+	};
+
+	// counters of the calling thread, no locking
+	Counters& local()
+	{
+		thread_local ThreadCounters instance;
+		return instance.counters;
+	}
+
+	// sum over all threads, read once the jobs are done
+	Counters totals()
+	{
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+
+		Counters sum = all.retired;
+		for (auto counters : all.live)
+		{
+			sum.add(*counters);
+		}
+		return sum;
+	}
+
+	void add(uint64_t Counters::* counter, uint64_t amount)
+	{
+		if (enabled())
+		{
+			local().*counter += amount;
+		}
+	}
+
+	// adds the lifetime of the scope to a phase
+	struct Timer
+	{
+		Phase phase;
+		bool running;
+		std::chrono::steady_clock::time_point start;
+
+		Timer(Phase _phase) : phase(_phase), running(enabled())
+		{
+			if (running)
+			{
+				start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~Timer()
+		{
+			if (running)
+			{
+				Counters& counters = local();
+				counters.phaseNanoseconds[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				counters.phaseCalls[phase]++;
+			}
+		}
+	};
+
+	void printTable(std::ostream& os, const Counters& counters)
+	{
+		os << std::left << std::setw(14) << "phase" << std::right << std::setw(12) << "calls" << std::setw(14) << "ms" << '\n';
+		for (int i = 0; i < PH_COUNT; i++)
+		{
+			if (counters.phaseCalls[i] == 0)
+			{
+				continue;
+			}
+			os << std::left << std::setw(14) << PHASE_NAMES[i] << std::right << std::setw(12) << counters.phaseCalls[i]
+				<< std::setw(14) << std::fixed << std::setprecision(3) << counters.phaseNanoseconds[i] / 1e6 << '\n';
+		}
+		os << '\n';
+		os << std::left << std::setw(14) << "tokens" << std::right << std::setw(12) << counters.tokens << '\n';
+		os << std::left << std::setw(14) << "lines" << std::right << std::setw(12) << counters.lines << '\n';
+		os << std::left << std::setw(14) << "records" << std::right << std::setw(12) << counters.records << '\n';
+		os << std::left << std::setw(14) << "labels" << std::right << std::setw(12) << counters.labels << '\n';
+		os << std::left << std::setw(14) << "lookups" << std::right << std::setw(12) << counters.symbolLookups << '\n';
+		os << std::left << std::setw(14) << "bytes read" << std::right << std::setw(12) << counters.bytesRead << '\n';
+		os << std::left << std::setw(14) << "bytes written" << std::right << std::setw(12) << counters.bytesWritten << '\n';
+		os << std::left << std::setw(14) << "allocations" << std::right << std::setw(12) << allocations << '\n';
+		os << std::left << std::setw(14) << "allocated" << std::right << std::setw(12) << allocatedBytes << '\n';
+	}
+
+	void printJson(std::ostream& os, const Counters& counters)
+	{
+		os << "{\n  \"phases\": {\n";
+		bool first = true;
+		for (int i = 0; i < PH_COUNT; i++)
+		{
+			if (counters.phaseCalls[i] == 0)
+			{
+				continue;
+			}
+			// nested phases are indented in PHASE_NAMES
+			const char* name = PHASE_NAMES[i];
+			while (*name == ' ')
+			{
+				name++;
+			}
+			os << (first ? "" : ",\n") << "    \"" << name << "\": { \"calls\": " << counters.phaseCalls[i] << ", \"nanoseconds\": " << counters.phaseNanoseconds[i] << " }";
+			first = false;
+		}
+		os << "\n  },\n";
+		os << "  \"tokens\": " << counters.tokens << ",\n";
+		os << "  \"lines\": " << counters.lines << ",\n";
+		os << "  \"records\": " << counters.records << ",\n";
+		os << "  \"labels\": " << counters.labels << ",\n";
+		os << "  \"symbolLookups\": " << counters.symbolLookups << ",\n";
+		os << "  \"bytesRead\": " << counters.bytesRead << ",\n";
+		os << "  \"bytesWritten\": " << counters.bytesWritten << ",\n";
+		os << "  \"allocations\": " << allocations << ",\n";
+		os << "  \"allocatedBytes\": " << allocatedBytes << "\n}\n";
+	}
+}
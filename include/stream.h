@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "diagnostics.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "symboltable.h"
+#include "onepass.h"
+#include "include.h"
+
+namespace assembler
+{
+	// assembles a source of any length read from input and writes the image to output
+	// as it becomes final. memory holds one window of whole lines, the symbol and fixup
+	// tables and the image behind the oldest unresolved forward reference. returns false
+	// on errors, the image written is incomplete then
+	bool assembleStream(std::istream& input, std::ostream& output, utils::Diagnostics& diagnostics, size_t window = 1 << 20, const std::string& includeDirectory = {})
+	{
+		std::vector<unsigned char> image;
+		OnePassAssembler onePass(image, diagnostics);
+
+		tokenizer::TokenStream tokens;
+		std::vector<char> buffer(std::max<size_t>(window, 1));
+		size_t filled = 0;
+		int64_t firstLine = 1;
+		uint64_t written = 0;
+
+		auto flush = [&](size_t count)
+		{
+			output.write(reinterpret_cast<const char*>(image.data()), count);
+			onePass.release(count);
+			written += count;
+		};
+
+		for (;;)
+		{
+			{
+				stats::Timer readTimer(stats::PH_READ);
+				input.read(buffer.data() + filled, buffer.size() - filled);
+			}
+			size_t read = static_cast<size_t>(input.gcount());
+			stats::add(&stats::Counters::bytesRead, read);
+			filled += read;
+			bool end = !input;
+
+			// whole lines only, the rest waits for the next read
+			size_t usable = filled;
+			if (!end)
+			{
+				auto newline = std::find(std::make_reverse_iterator(buffer.begin() + filled), buffer.rend(), '\n');
+				usable = static_cast<size_t>(buffer.rend() - newline);
+				if (usable == 0)
+				{
+					// a line longer than the window
+					buffer.resize(buffer.size() * 2);
+					continue;
+				}
+			}
+
+			std::string_view lines(buffer.data(), usable);
+			diagnostics.source = lines;
+			tokenizer::tokenize(lines, tokens, diagnostics, firstLine);
+			if (mayInclude(lines))
+			{
+				// includes take effect for the whole source, earlier windows included
+				size_t layers = onePass.symbolTable.layers.size();
+				attachIncludes(tokens, onePass.symbolTable, includeDirectory, diagnostics);
+				if (onePass.symbolTable.layers.size() != layers)
+				{
+					onePass.resolvePending();
+				}
+			}
+			{
+				stats::Timer onePassTimer(stats::PH_ONE_PASS);
+				for (size_t line = 0; line < tokens.lineCount(); line++)
+				{
+					onePass.feed(tokens.group(line));
+				}
+			}
+			firstLine += std::count(lines.begin(), lines.end(), '\n');
+			diagnostics.source = {};
+
+			flush(onePass.committed() - onePass.released);
+
+			std::copy(buffer.begin() + usable, buffer.begin() + filled, buffer.begin());
+			filled -= usable;
+
+			if (end)
+			{
+				break;
+			}
+		}
+
+		onePass.finish();
+		flush(image.size());
+		output.flush();
+
+		stats::add(&stats::Counters::bytesWritten, written);
+		diagnostics.sort();
+
+		return !diagnostics.hasErrors() && output.good();
+	}
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "tokenizer.h"
+
+namespace assembler
+{
+	enum class OperandType
+	{
+		OT_ADDRESS,
+		OT_LITERAL,
+		OT_NONE,
+	};
+	
+	struct Label
+	{
+		tokenizer::Token token;
+		OperandType labelType;
+		int labelValue;
+	};
+
+	// interned copies of symbol names, packed in blocks taken from a memory resource.
+	// the names outlive their source, e.g. a stream read window by window
+	struct NamePool
+	{
+		static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+		struct Block
+		{
+			char* data;
+			size_t size;
+		};
+
+		std::pmr::memory_resource* memory;
+		std::pmr::vector<Block> blocks;
+		// block names are added to and the bytes taken in it
+		size_t current = 0;
+		size_t used = 0;
+
+		explicit NamePool(std::pmr::memory_resource* _memory = std::pmr::get_default_resource())
+			: memory(_memory), blocks(_memory)
+		{
+		}
+
+		NamePool(const NamePool&) = delete;
+		NamePool& operator=(const NamePool&) = delete;
+
+		// labels keep viewing the names, the blocks move with the resource they came from
+		NamePool(NamePool&& other) noexcept
+			: memory(other.memory), blocks(std::move(other.blocks)), current(other.current), used(other.used)
+		{
+			other.blocks.clear();
+			other.clear();
+		}
+
+		NamePool& operator=(NamePool&& other) noexcept
+		{
+			if (this != &other)
+			{
+				release();
+				memory = other.memory;
+				blocks = std::move(other.blocks);
+				current = other.current;
+				used = other.used;
+				other.blocks.clear();
+				other.clear();
+			}
+			return *this;
+		}
+
+		~NamePool()
+		{
+			release();
+		}
+
+		std::string_view add(std::string_view name)
+		{
+			if (blocks.empty() || name.size() > blocks[current].size - used)
+			{
+				nextBlock(name.size());
+			}
+
+			char* copy = blocks[current].data + used;
+			std::copy(name.begin(), name.end(), copy);
+			used += name.size();
+			return { copy, name.size() };
+		}
+
+		tokenizer::Token add(const tokenizer::Token& token)
+		{
+			return { token.type, add(token.value) };
+		}
+
+		// forget every name but keep the blocks for the next job
+		void clear()
+		{
+			current = 0;
+			used = 0;
+		}
+
+		// before the memory resource is reset
+		void release()
+		{
+			for (auto& block : blocks)
+			{
+				memory->deallocate(block.data, block.size, 1);
+			}
+			utils::release(blocks);
+			current = 0;
+			used = 0;
+		}
+
+	private:
+		// the first kept block after the current one that fits, a new one otherwise.
+		// longer names get a block of their own
+		void nextBlock(size_t size)
+		{
+			size_t next = blocks.empty() ? 0 : current + 1;
+			while (next < blocks.size() && blocks[next].size < size)
+			{
+				next++;
+			}
+			if (next == blocks.size())
+			{
+				size_t capacity = std::max(size, BLOCK_SIZE);
+				blocks.push_back({ static_cast<char*>(memory->allocate(capacity, 1)), capacity });
+			}
+			current = next;
+			used = 0;
+		}
+	};
+
+	struct SymbolTable
+	{
+		static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+		struct Slot
+		{
+			uint32_t hash;
+			uint32_t index;
+		};
+
+		// dense label array, one entry per name. names are interned in the pool
+		std::pmr::vector<Label> labels;
+		// open addressing index into labels, capacity is a power of two
+		std::pmr::vector<Slot> slots;
+		// read only tables searched after this one, e.g. included definitions. names
+		// defined in them cannot be defined again
+		std::pmr::vector<const SymbolTable*> layers;
+		NamePool names;
+
+		SymbolTable() = default;
+
+		explicit SymbolTable(std::pmr::memory_resource* memory)
+			: labels(memory), slots(memory), layers(memory), names(memory)
+		{
+		}
+
+		static uint32_t hashName(std::string_view name)
+		{
+			// FNV-1a
+			uint32_t hash = 2166136261u;
+			for (char c : name)
+			{
+				hash ^= static_cast<unsigned char>(c);
+				hash *= 16777619u;
+			}
+			return hash;
+		}
+
+		void reserve(size_t count)
+		{
+			labels.reserve(count);
+
+			size_t capacity = 16;
+			while (capacity < count * 2)
+			{
+				capacity <<= 1;
+			}
+			if (capacity > slots.size())
+			{
+				rehash(capacity);
+			}
+		}
+
+		// returns the slot holding name, or the empty slot where it belongs
+		size_t probe(std::string_view name, uint32_t hash) const
+		{
+			size_t mask = slots.size() - 1;
+			size_t i = hash & mask;
+
+			while (slots[i].index != EMPTY_SLOT)
+			{
+				if (slots[i].hash == hash && labels[slots[i].index].token.value == name)
+				{
+					break;
+				}
+				i = (i + 1) & mask;
+			}
+			return i;
+		}
+
+		// returns false if the symbol is already defined
+		bool define(const tokenizer::Token& symbol, int value, OperandType type)
+		{
+			// keep the load factor at or below one half
+			if ((labels.size() + 1) * 2 > slots.size())
+			{
+				rehash(slots.empty() ? 16 : slots.size() * 2);
+			}
+
+			uint32_t hash = hashName(symbol.value);
+			size_t i = probe(symbol.value, hash);
+
+			if (slots[i].index != EMPTY_SLOT || findLayered(symbol.value, hash) != nullptr)
+			{
+				return false;
+			}
+
+			slots[i] = { hash, static_cast<uint32_t>(labels.size()) };
+			labels.push_back({ names.add(symbol), type, value });
+			return true;
+		}
+
+		const Label* find(std::string_view name) const
+		{
+			return find(name, hashName(name));
+		}
+
+		const Label* find(std::string_view name, uint32_t hash) const
+		{
+			if (!slots.empty())
+			{
+				size_t i = probe(name, hash);
+				if (slots[i].index != EMPTY_SLOT)
+				{
+					return &labels[slots[i].index];
+				}
+			}
+			return findLayered(name, hash);
+		}
+
+		const Label* findLayered(std::string_view name, uint32_t hash) const
+		{
+			for (auto layer : layers)
+			{
+				const Label* label = layer->find(name, hash);
+				if (label != nullptr)
+				{
+					return label;
+				}
+			}
+			return nullptr;
+		}
+
+		// label of this table itself, not of a layer
+		bool owns(const Label* label) const
+		{
+			return label >= labels.data() && label < labels.data() + labels.size();
+		}
+
+		size_t size() const
+		{
+			return labels.size();
+		}
+
+		// forget every label and layer but keep the memory for the next job
+		void clear()
+		{
+			labels.clear();
+			std::fill(slots.begin(), slots.end(), Slot{ 0, EMPTY_SLOT });
+			layers.clear();
+			names.clear();
+		}
+
+		// before the memory resource is reset
+		void release()
+		{
+			utils::release(labels);
+			utils::release(slots);
+			utils::release(layers);
+			names.release();
+		}
+
+	private:
+		void rehash(size_t capacity)
+		{
+			std::pmr::vector<Slot> old(capacity, { 0, EMPTY_SLOT }, slots.get_allocator());
+			old.swap(slots);
+
+			// the hashes are kept in the slots, no name is read again
+			size_t mask = capacity - 1;
+			for (auto& slot : old)
+			{
+				if (slot.index == EMPTY_SLOT)
+				{
+					continue;
+				}
+				size_t i = slot.hash & mask;
+				while (slots[i].index != EMPTY_SLOT)
+				{
+					i = (i + 1) & mask;
+				}
+				slots[i] = slot;
+			}
+		}
+	};
+}
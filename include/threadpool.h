@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+	// work stealing pool : every worker owns a deque, runs its own tasks newest first
+	// and steals the oldest task of another worker once it runs dry
+	struct ThreadPool
+	{
+		struct Worker
+		{
+			std::deque<std::function<void()>> tasks;
+			std::mutex mutex;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> threads;
+
+		// tasks sitting in a deque, guarded by sleepMutex when it goes up
+		std::atomic<size_t> queued{ 0 };
+		// tasks submitted but not finished yet
+		std::atomic<size_t> pending{ 0 };
+		std::atomic<size_t> nextWorker{ 0 };
+		bool stopping = false;
+
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		std::mutex doneMutex;
+		std::condition_variable done;
+		// threads in wait(batch) that sleep on done, woken by submit as well
+		std::atomic<size_t> helpers{ 0 };
+
+		// tasks of one caller, wait(batch) returns once they are done
+		struct Batch
+		{
+			std::atomic<size_t> pending{ 0 };
+		};
+
+		explicit ThreadPool(size_t threadCount = 0)
+		{
+			if (threadCount == 0)
+			{
+				threadCount = std::max(1u, std::thread::hardware_concurrency());
+			}
+
+			for (size_t i = 0; i < threadCount; i++)
+			{
+				workers.push_back(std::make_unique<Worker>());
+			}
+			for (size_t i = 0; i < threadCount; i++)
+			{
+				threads.emplace_back([this, i]() { run(i); });
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator = (const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stopping = true;
+			}
+			wake.notify_all();
+
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+		}
+
+		size_t size() const
+		{
+			return workers.size();
+		}
+
+		static size_t& currentWorker()
+		{
+			// index of the worker running on this thread, or size_t(-1) outside the pool
+			thread_local size_t index = static_cast<size_t>(-1);
+			return index;
+		}
+
+		void submit(std::function<void()> task)
+		{
+			// tasks spawned by a task stay with that worker, others are dealt round robin
+			size_t index = currentWorker();
+			if (index >= workers.size())
+			{
+				index = nextWorker++ % workers.size();
+			}
+
+			pending++;
+			{
+				std::lock_guard<std::mutex> lock(workers[index]->mutex);
+				workers[index]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				queued++;
+			}
+			wake.notify_one();
+
+			if (helpers > 0)
+			{
+				std::lock_guard<std::mutex> lock(doneMutex);
+				done.notify_all();
+			}
+		}
+
+		void submit(Batch& batch, std::function<void()> task)
+		{
+			batch.pending++;
+			submit([this, &batch, task = std::move(task)]()
+			{
+				task();
+
+				// batch may be gone once its count is zero
+				if (--batch.pending == 0)
+				{
+					std::lock_guard<std::mutex> lock(doneMutex);
+					done.notify_all();
+				}
+			});
+		}
+
+		// block until every submitted task has finished, must not be called from a task
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(doneMutex);
+			done.wait(lock, [this]() { return pending == 0; });
+		}
+
+		// block until the tasks of batch have finished and run queued tasks meanwhile,
+		// safe from inside a task
+		void wait(Batch& batch)
+		{
+			size_t index = currentWorker();
+			if (index >= workers.size())
+			{
+				index = 0;
+			}
+
+			while (batch.pending > 0)
+			{
+				std::function<void()> task;
+				if (take(index, task))
+				{
+					execute(task);
+					continue;
+				}
+
+				helpers++;
+				{
+					std::unique_lock<std::mutex> lock(doneMutex);
+					done.wait(lock, [&]() { return batch.pending == 0 || queued > 0; });
+				}
+				helpers--;
+			}
+		}
+
+		// run body(i) for i in [0, count) and wait for all of them, safe from inside a task
+		void parallelFor(size_t count, const std::function<void(size_t)>& body)
+		{
+			Batch batch;
+			for (size_t i = 0; i < count; i++)
+			{
+				submit(batch, [&body, i]() { body(i); });
+			}
+			wait(batch);
+		}
+
+	private:
+		bool take(size_t index, std::function<void()>& task)
+		{
+			// own deque from the back
+			{
+				Worker& worker = *workers[index];
+				std::lock_guard<std::mutex> lock(worker.mutex);
+				if (!worker.tasks.empty())
+				{
+					task = std::move(worker.tasks.back());
+					worker.tasks.pop_back();
+					queued--;
+					return true;
+				}
+			}
+
+			// steal from the front of the others
+			for (size_t i = 1; i < workers.size(); i++)
+			{
+				Worker& victim = *workers[(index + i) % workers.size()];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tasks.empty())
+				{
+					task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					queued--;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void execute(std::function<void()>& task)
+		{
+			task();
+
+			if (--pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(doneMutex);
+				done.notify_all();
+			}
+		}
+
+		void run(size_t index)
+		{
+			currentWorker() = index;
+
+			while (true)
+			{
+				std::function<void()> task;
+				if (take(index, task))
+				{
+					execute(task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wake.wait(lock, [this]() { return stopping || queued > 0; });
+				if (stopping && queued == 0)
+				{
+					return;
+				}
+			}
+		}
+	};
+}
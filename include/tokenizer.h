@@ -2,12 +2,19 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstdint>
 #include <algorithm>
 #include <map>
 #include <fstream>
+#include <memory_resource>
 
 #include "utils.h"
+#include "arena.h"
+#include "diagnostics.h"
+#include "stats.h"
+#include "charclass.h"
 
 const std::string TOKEN_PATH = "tokens.tkz";
 
@@ -30,7 +37,8 @@ namespace tokenizer
 	struct Token
 	{
 		TokenType type;
-		std::string value;
+		// view into the source buffer, valid as long as the buffer is
+		std::string_view value;
 
 		bool operator == (Token const& other)
 		{
@@ -79,177 +87,358 @@ namespace tokenizer
 		}
 	};
 
-	struct TokenGroup
+	// what a line declares or assembles to, decided while it is lexed. the values are
+	// those of assembler::RecordType
+	enum class LineShape : uint8_t
 	{
-		std::vector<Token> tokens;
-		int line;
+		LS_DEF_ADDRESS,
+		LS_DEF_LITERAL,
+		LS_DEF_LABEL,
+
+		LS_INS_ADDRESS,
+		LS_INS_LITERAL,
+		LS_INS_LABEL,
+		LS_INS_NONE
+	};
 
-		bool operator == (TokenGroup const& other)
+	// the line grammar as a deterministic automaton over token types, built at compile
+	// time. the lexer takes one transition per token and the state after the newline
+	// is the shape of the line
+	namespace grammar
+	{
+		const size_t TOKEN_TYPES = static_cast<size_t>(TokenType::TK_NEWLINE) + 1;
+		const size_t SHAPES = static_cast<size_t>(LineShape::LS_INS_NONE) + 1;
+		const size_t MAX_STATES = 64;
+
+		// error states keep the automaton until the line ends
+		enum : uint8_t
 		{
-			if (tokens.size() != other.tokens.size())
-			{
-				return false;
-			}
-			for (int i = 0; i < tokens.size(); i++)
+			ST_START,
+			// a token that may never follow the one before it
+			ST_UNEXPECTED,
+			// tokens in a sequence no line has, e.g. past the operand
+			ST_ORDER,
+			// one per shape, entered on the newline
+			ST_ACCEPT,
+			ST_FIRST_FREE = ST_ACCEPT + SHAPES
+		};
+
+		struct Production
+		{
+			LineShape shape;
+			size_t length;
+			TokenType tokens[5];
+		};
+
+		constexpr Production PRODUCTIONS[] =
+		{
+			{ LineShape::LS_DEF_ADDRESS, 5, { TokenType::TK_SYMBOL, TokenType::TK_EQUAL, TokenType::TK_DOLLAR, TokenType::TK_ADDRESS, TokenType::TK_NEWLINE } },
+			{ LineShape::LS_DEF_LITERAL, 5, { TokenType::TK_SYMBOL, TokenType::TK_EQUAL, TokenType::TK_PERCENT, TokenType::TK_LITERAL, TokenType::TK_NEWLINE } },
+			{ LineShape::LS_DEF_LABEL, 3, { TokenType::TK_SYMBOL, TokenType::TK_COLON, TokenType::TK_NEWLINE } },
+			{ LineShape::LS_INS_ADDRESS, 5, { TokenType::TK_SYMBOL, TokenType::TK_COMMA, TokenType::TK_DOLLAR, TokenType::TK_ADDRESS, TokenType::TK_NEWLINE } },
+			{ LineShape::LS_INS_LITERAL, 5, { TokenType::TK_SYMBOL, TokenType::TK_COMMA, TokenType::TK_PERCENT, TokenType::TK_LITERAL, TokenType::TK_NEWLINE } },
+			{ LineShape::LS_INS_LABEL, 4, { TokenType::TK_SYMBOL, TokenType::TK_COMMA, TokenType::TK_SYMBOL, TokenType::TK_NEWLINE } },
+			{ LineShape::LS_INS_NONE, 2, { TokenType::TK_SYMBOL, TokenType::TK_NEWLINE } }
+		};
+
+		// whether next may directly follow previous in any line, null for the first
+		// token. a token that may but does not fit the line is an order error
+		constexpr bool mayFollow(const TokenType* previous, TokenType next)
+		{
+			for (auto& production : PRODUCTIONS)
 			{
-				if (tokens[i] != other.tokens[i])
+				for (size_t i = 0; i < production.length; i++)
 				{
-					return false;
+					if (production.tokens[i] == next && (i == 0 ? previous == nullptr : previous != nullptr && production.tokens[i - 1] == *previous))
+					{
+						return true;
+					}
 				}
 			}
-			return true;
+			return false;
 		}
 
-		bool operator != (TokenGroup const& other)
+		struct Automaton
 		{
-			return !(*this == other);
-		}
+			uint8_t next[MAX_STATES][TOKEN_TYPES] = {};
+			size_t stateCount = 0;
 
-		friend std::ofstream& operator << (std::ofstream& os, const TokenGroup& tg)
-		{
-			for (auto& token : tg.tokens)
+			constexpr uint8_t step(uint8_t state, TokenType type) const
 			{
-				os << token;
+				return next[state][static_cast<size_t>(type)];
 			}
-			os << '/';
-			os << tg.line;
-			os << '\n';
 
-			return os;
-		}
+			static constexpr bool isError(uint8_t state)
+			{
+				return state == ST_UNEXPECTED || state == ST_ORDER;
+			}
 
-		friend std::ifstream& operator >> (std::ifstream& is, TokenGroup& tg)
+			static constexpr bool isAccepting(uint8_t state)
+			{
+				return state >= ST_ACCEPT && state < ST_FIRST_FREE;
+			}
+
+			static constexpr LineShape shape(uint8_t state)
+			{
+				return static_cast<LineShape>(state - ST_ACCEPT);
+			}
+		};
+
+		// a trie of the productions, then every missing transition is pointed at an
+		// error state
+		constexpr Automaton build()
 		{
-			std::vector<Token> tokens;
-			int line = 0;
+			Automaton automaton;
+			// token each state was entered with
+			TokenType last[MAX_STATES] = {};
+			size_t count = ST_FIRST_FREE;
 
-			char c;
-			TokenType type = TokenType::TK_SYMBOL;
-			std::string value;
-			std::string symbol;
-			bool eol = false;
+			for (auto& production : PRODUCTIONS)
+			{
+				size_t state = ST_START;
+				for (size_t i = 0; i < production.length; i++)
+				{
+					size_t type = static_cast<size_t>(production.tokens[i]);
+					if (i + 1 == production.length)
+					{
+						automaton.next[state][type] = static_cast<uint8_t>(ST_ACCEPT + static_cast<size_t>(production.shape));
+						break;
+					}
+					if (automaton.next[state][type] == ST_START)
+					{
+						last[count] = production.tokens[i];
+						automaton.next[state][type] = static_cast<uint8_t>(count++);
+					}
+					state = automaton.next[state][type];
+				}
+			}
 
-			while (!eol && !is.eof() && is >> c)
+			for (size_t state = 0; state < count; state++)
 			{
-				switch (c)
+				for (size_t type = 0; type < TOKEN_TYPES; type++)
 				{
-				case '%':
-					// literal
-					type = TokenType::TK_LITERAL;
-					tokens.push_back({ TokenType::TK_PERCENT, "PERCENT(%)" });
-					break;
-				case '$':
-					// address
-					type = TokenType::TK_ADDRESS;
-					tokens.push_back({ TokenType::TK_DOLLAR, "DOLLAR($)" });
-					break;
-				case '=':
-					tokens.push_back({ TokenType::TK_EQUAL, "EQUAL(=)" });
-					break;
-				case ':':
-					tokens.push_back({ TokenType::TK_COLON, "COLON(:)" });
-					break;
-				case ',':
-					tokens.push_back({ TokenType::TK_COMMA, "COMMA(,)" });
-					break;
-
-				case '|':
-					// eof symbol
-					tokens.push_back({ type, symbol });
-					symbol.clear();
-					break;
-				case '!':
-					// symbol
-					type = TokenType::TK_SYMBOL;
-					break;
-
-				case '/':
-					// end of line
-					eol = true;
-
-					//get line number
-					value.clear();
-					while (is.get(c) && c != '\n')
+					if (state == ST_UNEXPECTED || state == ST_ORDER)
 					{
-						value.push_back(c);
+						automaton.next[state][type] = static_cast<uint8_t>(state);
+						continue;
+					}
+					if (automaton.next[state][type] != ST_START)
+					{
+						continue;
 					}
-					line = stoi(value);
 
-					tokens.push_back({ TokenType::TK_NEWLINE, "NEWLINE(\\n)" });
-					break;
-				default:
-					symbol.push_back(c);
-					break;
+					// nothing follows the newline
+					bool follows = (state == ST_START || state >= ST_FIRST_FREE) &&
+						mayFollow(state == ST_START ? nullptr : &last[state], static_cast<TokenType>(type));
+					automaton.next[state][type] = follows ? ST_ORDER : ST_UNEXPECTED;
 				}
 			}
-			tg = { tokens, line };
 
-			return is;
+			automaton.stateCount = count;
+			return automaton;
+		}
+
+		constexpr Automaton LINE_AUTOMATON = build();
+
+		static_assert(LINE_AUTOMATON.stateCount <= MAX_STATES, "line grammar needs more states");
+		static_assert(Automaton::shape(LINE_AUTOMATON.step(LINE_AUTOMATON.step(ST_START, TokenType::TK_SYMBOL), TokenType::TK_NEWLINE)) == LineShape::LS_INS_NONE, "line grammar is broken");
+	}
+
+	struct TokenGroup;
+
+	// columnar token stream, one entry per token in each array
+	struct TokenStream
+	{
+		std::string_view source;
+
+		std::pmr::vector<unsigned char> kinds;
+		std::pmr::vector<uint32_t> offsets;
+		std::pmr::vector<uint32_t> lengths;
+
+		// index of the first token of every line, its source line number and shape
+		std::pmr::vector<uint32_t> lineStarts;
+		std::pmr::vector<int64_t> lineNumbers;
+		std::pmr::vector<LineShape> lineShapes;
+
+		// automaton state of the line being lexed, and its first token out of grammar
+		uint8_t lineState = grammar::ST_START;
+		uint32_t rejected = 0;
+
+		TokenStream() = default;
+
+		explicit TokenStream(std::pmr::memory_resource* memory)
+			: kinds(memory), offsets(memory), lengths(memory), lineStarts(memory), lineNumbers(memory), lineShapes(memory)
+		{
+		}
+
+		size_t size() const
+		{
+			return kinds.size();
+		}
+
+		size_t lineCount() const
+		{
+			return lineStarts.size();
+		}
+
+		TokenType type(size_t i) const
+		{
+			return static_cast<TokenType>(kinds[i]);
+		}
+
+		std::string_view value(size_t i) const
+		{
+			return source.substr(offsets[i], lengths[i]);
+		}
+
+		Token token(size_t i) const
+		{
+			return { type(i), value(i) };
+		}
+
+		// appends a token and advances the line automaton by it
+		void push(TokenType type, std::string_view value)
+		{
+			uint8_t state = grammar::LINE_AUTOMATON.step(lineState, type);
+			if (state != lineState && grammar::Automaton::isError(state))
+			{
+				rejected = static_cast<uint32_t>(kinds.size());
+			}
+			lineState = state;
+
+			kinds.push_back(static_cast<unsigned char>(type));
+			offsets.push_back(static_cast<uint32_t>(value.data() - source.data()));
+			lengths.push_back(static_cast<uint32_t>(value.size()));
+		}
+
+		// drop every token from index first onwards
+		void truncate(size_t first)
+		{
+			kinds.resize(first);
+			offsets.resize(first);
+			lengths.resize(first);
+		}
+
+		void clear()
+		{
+			truncate(0);
+			lineStarts.clear();
+			lineNumbers.clear();
+			lineShapes.clear();
+			lineState = grammar::ST_START;
+		}
+
+		// before the memory resource is reset
+		void release()
+		{
+			source = {};
+			utils::release(kinds);
+			utils::release(offsets);
+			utils::release(lengths);
+			utils::release(lineStarts);
+			utils::release(lineNumbers);
+			utils::release(lineShapes);
 		}
+
+		TokenGroup group(size_t line) const;
 	};
 
-	void validateTokens(TokenGroup& tokenGroup)
+	// view of the tokens of one line in a TokenStream
+	struct TokenGroup
 	{
+		const TokenStream* stream;
+		uint32_t first;
+		uint32_t count;
+		int64_t line;
+		LineShape shape;
 
-		std::vector <TokenType> excpectedTokens = { TokenType::TK_SYMBOL, TokenType::TK_NEWLINE };
+		size_t size() const
+		{
+			return count;
+		}
+
+		TokenType type(size_t i) const
+		{
+			return stream->type(first + i);
+		}
+
+		Token operator [] (size_t i) const
+		{
+			return stream->token(first + i);
+		}
 
-		for (auto& token : tokenGroup.tokens)
+		bool operator == (TokenGroup const& other)
 		{
-			if (std::find(excpectedTokens.begin(), excpectedTokens.end(), token.type) == excpectedTokens.end())
+			if (count != other.count)
 			{
-				utils::Error(utils::ErrorType::ER_UNEXPECTED_TOKEN, tokenGroup.line);
+				return false;
 			}
-			switch (token.type)
+			for (uint32_t i = 0; i < count; i++)
 			{
-			case TokenType::TK_SYMBOL:
-				excpectedTokens = { TokenType::TK_EQUAL, TokenType::TK_COLON, TokenType::TK_COMMA, TokenType::TK_NEWLINE };
-				break;
-			case TokenType::TK_LITERAL:
-				excpectedTokens = { TokenType::TK_COMMA, TokenType::TK_NEWLINE };
-				break;
-			case TokenType::TK_ADDRESS:
-				excpectedTokens = { TokenType::TK_COMMA, TokenType::TK_NEWLINE };
-				break;
-			case TokenType::TK_EQUAL:
-				excpectedTokens = { TokenType::TK_DOLLAR, TokenType::TK_PERCENT };
-				break;
-			case TokenType::TK_PERCENT:
-				excpectedTokens = { TokenType::TK_LITERAL };
-				break;
-			case TokenType::TK_DOLLAR:
-				excpectedTokens = { TokenType::TK_ADDRESS };
-				break;
-			case TokenType::TK_COLON:
-				excpectedTokens = { TokenType::TK_NEWLINE };
-				break;
-			case TokenType::TK_COMMA:
-				excpectedTokens = { TokenType::TK_PERCENT, TokenType::TK_DOLLAR, TokenType::TK_SYMBOL };
-				break;
+				if ((*this)[i] != other[i])
+				{
+					return false;
+				}
 			}
+			return true;
+		}
+
+		bool operator != (TokenGroup const& other)
+		{
+			return !(*this == other);
 		}
+
+		friend std::ofstream& operator << (std::ofstream& os, const TokenGroup& tg)
+		{
+			for (uint32_t i = 0; i < tg.count; i++)
+			{
+				os << tg[i];
+			}
+			os << '/';
+			os << tg.line;
+			os << '\n';
+
+			return os;
+		}
+	};
+
+	TokenGroup TokenStream::group(size_t line) const
+	{
+		uint32_t first = lineStarts[line];
+		uint32_t last = (line + 1 < lineStarts.size()) ? lineStarts[line + 1] : static_cast<uint32_t>(kinds.size());
+
+		return { this, first, last - first, lineNumbers[line], lineShapes[line] };
 	}
 
-	void identifySymbol(std::string& currentString, TokenType& previousTokenType, TokenType& stringType, int currentLine)
+	bool isHex(std::string_view string)
 	{
+		return scanKernels().scanHex(string.data(), string.size()) == string.size();
+	}
+
+	// a malformed number is reported and kept as a symbol, its line is dropped anyway
+	void identifySymbol(std::string_view currentString, TokenType& previousTokenType, TokenType& stringType, int64_t currentLine, utils::Diagnostics& diagnostics)
+	{
+		stringType = TokenType::TK_SYMBOL;
+
 		switch (previousTokenType)
 		{
 		case TokenType::TK_DOLLAR:
 			// is hex & of length 4
-			if (currentString.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos && currentString.length() == 4)
+			if (currentString.length() == 4 && isHex(currentString))
 			{
 				stringType = TokenType::TK_ADDRESS;
 				break;
 			}
-			utils::Error( utils::ErrorType::ER_UNRECOGNIZED_NUM, currentLine );
+			diagnostics.report(utils::ErrorType::ER_UNRECOGNIZED_NUM, currentLine, currentString);
 			break;
 		case TokenType::TK_PERCENT:
 			// is hex & of length 2
-			if (currentString.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos && currentString.length() == 2)
+			if (currentString.length() == 2 && isHex(currentString))
 			{
 				stringType = TokenType::TK_LITERAL;
 				break;
 			}
-			utils::Error( utils::ErrorType::ER_UNRECOGNIZED_NUM, currentLine );
+			diagnostics.report(utils::ErrorType::ER_UNRECOGNIZED_NUM, currentLine, currentString);
 			break;
 		default:
 			stringType = TokenType::TK_SYMBOL;
@@ -257,172 +446,156 @@ namespace tokenizer
 		}
 	}
 
-	void appendToken(TokenGroup& tokenGroup, TokenType type, std::string& currentSymbol, TokenType& previousTokenType, int currentLine, std::string value)
+	void flushSymbol(TokenStream& tokens, std::string_view& currentSymbol, TokenType& previousTokenType, int64_t currentLine, utils::Diagnostics& diagnostics)
 	{
 		if (!currentSymbol.empty())
 		{
 			TokenType symbolType;
 
-			identifySymbol(currentSymbol, previousTokenType, symbolType, currentLine);
+			identifySymbol(currentSymbol, previousTokenType, symbolType, currentLine, diagnostics);
 
-			tokenGroup.tokens.push_back({ symbolType, currentSymbol });
+			tokens.push(symbolType, currentSymbol);
 		}
 
-		currentSymbol.clear();
+		currentSymbol = {};
+	}
+
+	void appendToken(TokenStream& tokens, TokenType type, std::string_view& currentSymbol, TokenType& previousTokenType, int64_t currentLine, std::string_view value, utils::Diagnostics& diagnostics)
+	{
+		flushSymbol(tokens, currentSymbol, previousTokenType, currentLine, diagnostics);
+
 		previousTokenType = type;
 
-		tokenGroup.tokens.push_back({ type, value });
+		tokens.push(type, value);
 	}
 
-	void writeLine(std::ofstream& tokenFile, TokenGroup& tokenGroup, int& currentLine)
+	// lineErrors is the error count when the line started, lines with errors are dropped
+	void writeLine(TokenStream& tokens, size_t& lineFirst, int64_t& currentLine, size_t& lineErrors, utils::Diagnostics& diagnostics)
 	{
-		tokenGroup.line = currentLine;
+		uint8_t state = tokens.lineState;
+		bool lexed = tokens.size() - lineFirst > 1 && diagnostics.errorCount == lineErrors;
+
+		// the first token out of grammar is reported, unless lexing failed already
+		if (lexed && grammar::Automaton::isError(state))
+		{
+			utils::ErrorType error = state == grammar::ST_UNEXPECTED ? utils::ErrorType::ER_UNEXPECTED_TOKEN : utils::ErrorType::ER_INVALID_TOKEN_ORDER;
+			diagnostics.report(error, currentLine, tokens.value(tokens.rejected));
+		}
 
-		// skip newlines
-		if (tokenGroup.tokens.size() > 1)
+		// skip newlines and lines that failed to lex or fit no shape
+		if (lexed && grammar::Automaton::isAccepting(state))
+		{
+			tokens.lineStarts.push_back(static_cast<uint32_t>(lineFirst));
+			tokens.lineNumbers.push_back(currentLine);
+			tokens.lineShapes.push_back(grammar::Automaton::shape(state));
+		}
+		else
 		{
-			// validate and write onto tokenfile
-			validateTokens(tokenGroup);
-			tokenFile << tokenGroup;
+			tokens.truncate(lineFirst);
 		}
 
+		tokens.lineState = grammar::ST_START;
 		currentLine++;
-		tokenGroup.tokens.clear();
+		lineFirst = tokens.size();
+		lineErrors = diagnostics.errorCount;
 	}
 
-	void tokenize(const std::string filename)
+	void dumpTokens(const TokenStream& tokens, const std::string& path = utils::RES_PATH + TOKEN_PATH)
 	{
-		// load file
-		std::ifstream rawFile(utils::RES_PATH + filename);
-		if (!rawFile.is_open())
+		std::ofstream tokenFile(path);
+
+		for (size_t line = 0; line < tokens.lineCount(); line++)
 		{
-			utils::Error(utils::ErrorType::ER_LOADING_FILE, 0);
-			return;
+			tokenFile << tokens.group(line);
 		}
 
-		int currentLine = 1;
-		std::string currentString = "";
-		TokenType previousTokenType = TokenType::TK_SYMBOL;
-		TokenGroup tokenGroup;
+		tokenFile.close();
+	}
 
-		//open intermediary file
-		std::ofstream tokenFile(utils::RES_PATH + TOKEN_PATH);
+	// spaces and tabs separate tokens and end a symbol or number, "LDA, my label" holds
+	// the two symbols my and label and is out of grammar. the original lexer dropped them
+	// and read mylabel, tokens view the source now and a joined name is not in it
+	void tokenize(std::string_view source, TokenStream& tokens, utils::Diagnostics& diagnostics, int64_t firstLine = 1)
+	{
+		stats::Timer timer(stats::PH_LEX);
+		const ScanKernels& kernels = scanKernels();
+
+		tokens.clear();
+		tokens.source = source;
+		// rough guess of one token every four bytes
+		tokens.kinds.reserve(source.size() / 4);
+		tokens.offsets.reserve(source.size() / 4);
+		tokens.lengths.reserve(source.size() / 4);
+
+		int64_t currentLine = firstLine;
+		std::string_view currentString;
+		TokenType previousTokenType = TokenType::TK_SYMBOL;
+		size_t lineFirst = 0;
+		size_t lineErrors = diagnostics.errorCount;
 
-		char c;
-		while(rawFile.get(c))
+		size_t i = 0;
+		while (i < source.size())
 		{
-			switch (c)
+			char c = source[i];
+			unsigned char cls = charClass(c);
+
+			if (cls & CC_SPACE)
 			{
-			case ' ':
-			case '\t':
-				break;
+				flushSymbol(tokens, currentString, previousTokenType, currentLine, diagnostics);
+				i += kernels.skipWhitespace(source.data() + i, source.size() - i);
+				continue;
+			}
+
+			if (cls & CC_IDENT)
+			{
+				size_t length = kernels.scanIdentifier(source.data() + i, source.size() - i);
+				currentString = source.substr(i, length);
+				i += length;
+				continue;
+			}
 
+			// punctuation tokens view their own character
+			std::string_view value = source.substr(i, 1);
+			i++;
+
+			switch (c)
+			{
 			case '%':
-				appendToken(tokenGroup, TokenType::TK_PERCENT, currentString, previousTokenType, currentLine, "PERCENT(%)");
+				appendToken(tokens, TokenType::TK_PERCENT, currentString, previousTokenType, currentLine, value, diagnostics);
 				break;
 
 			case '$':
-				appendToken(tokenGroup, TokenType::TK_DOLLAR, currentString, previousTokenType, currentLine, "DOLLAR($)");
+				appendToken(tokens, TokenType::TK_DOLLAR, currentString, previousTokenType, currentLine, value, diagnostics);
 				break;
 
 			case '=':
-				appendToken(tokenGroup, TokenType::TK_EQUAL, currentString, previousTokenType, currentLine, "EQUAL(=)");
+				appendToken(tokens, TokenType::TK_EQUAL, currentString, previousTokenType, currentLine, value, diagnostics);
 				break;
 
 			case ':':
-				appendToken(tokenGroup, TokenType::TK_COLON, currentString, previousTokenType, currentLine, "COLON(:)");
+				appendToken(tokens, TokenType::TK_COLON, currentString, previousTokenType, currentLine, value, diagnostics);
 				break;
 
 			case ',':
-				appendToken(tokenGroup, TokenType::TK_COMMA, currentString, previousTokenType, currentLine, "COMMA(,)");
+				appendToken(tokens, TokenType::TK_COMMA, currentString, previousTokenType, currentLine, value, diagnostics);
 				break;
 
 			case '\n':
-				appendToken(tokenGroup, TokenType::TK_NEWLINE, currentString, previousTokenType, currentLine, "NEWLINE(\\n)");
-				
-				writeLine(tokenFile, tokenGroup, currentLine);
-				break;
+				appendToken(tokens, TokenType::TK_NEWLINE, currentString, previousTokenType, currentLine, value, diagnostics);
 
-			case 'a':
-			case 'b':
-			case 'c':
-			case 'd':
-			case 'e':
-			case 'f':
-			case 'g':
-			case 'h':
-			case 'i':
-			case 'j':
-			case 'k':
-			case 'l':
-			case 'm':
-			case 'n':
-			case 'o':
-			case 'p':
-			case 'q':
-			case 'r':
-			case 's':
-			case 't':
-			case 'u':
-			case 'v':
-			case 'w':
-			case 'x':
-			case 'y':
-			case 'z':
-
-			case 'A':
-			case 'B':
-			case 'C':
-			case 'D':
-			case 'E':
-			case 'F':
-			case 'G':
-			case 'H':
-			case 'I':
-			case 'J':
-			case 'K':
-			case 'L':
-			case 'M':
-			case 'N':
-			case 'O':
-			case 'P':
-			case 'Q':
-			case 'R':
-			case 'S':
-			case 'T':
-			case 'U':
-			case 'V':
-			case 'W':
-			case 'X':
-			case 'Y':
-			case 'Z':
-
-			case '_':
-			case '-':
-			case '.':
-
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				currentString.push_back(c);
+				writeLine(tokens, lineFirst, currentLine, lineErrors, diagnostics);
 				break;
 
 			default:
-				utils::Error( utils::ErrorType::ER_UNRECOGNIZED_CHAR, currentLine );
+				diagnostics.report(utils::ErrorType::ER_UNRECOGNIZED_CHAR, currentLine, value);
 				break;
 			}
 		}
-		appendToken(tokenGroup, TokenType::TK_NEWLINE, currentString, previousTokenType, currentLine, "NEWLINE(\\n)");
+		appendToken(tokens, TokenType::TK_NEWLINE, currentString, previousTokenType, currentLine, source.substr(source.size()), diagnostics);
 
-		writeLine(tokenFile, tokenGroup, currentLine);
+		writeLine(tokens, lineFirst, currentLine, lineErrors, diagnostics);
 
-		tokenFile.close();
+		stats::add(&stats::Counters::tokens, tokens.size());
+		stats::add(&stats::Counters::lines, tokens.lineCount());
 	}
 }
\ No newline at end of file
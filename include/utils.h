@@ -2,6 +2,9 @@
 
 #include <unordered_map>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <charconv>
 
 namespace utils
 {
@@ -17,10 +20,16 @@ namespace utils
 		ER_INVALID_TOKEN_ORDER,
 
 		ER_LOADING_FILE,
+		ER_LOADING_INCLUDE,
+		ER_INVALID_OBJECT,
 
 		ER_MULTIPLY_DEFINED_LABELS,
 		ER_INVALID_OPERAND,
-		ER_UNRECOGNIZED_OPERATION
+		ER_UNRECOGNIZED_OPERATION,
+		ER_CROSS_CHECK_MISMATCH,
+		ER_INCLUDE_NOT_DEFINITIONS,
+		ER_UNDEFINED_SYMBOL,
+		ER_AMBIGUOUS_SYMBOL
 	};
 
 #pragma warning( push )
@@ -36,18 +45,26 @@ namespace utils
 	std::unordered_map<ErrorType, ErrorInfo> ErrorInfoMap
 	{
 
-		{ ErrorType::ER_UNEXPECTED_TOKEN,			{100,	"\"unexpected token found\"",		true} },
-		{ ErrorType::ER_UNRECOGNIZED_CHAR,			{101,	"\"unrecognized character found\"",	true} },
-		{ ErrorType::ER_UNRECOGNIZED_NUM,			{102,	"\"unrecognized numerical found\"",	true} },
-		{ ErrorType::ER_INVALID_TOKEN_ORDER,		{103,	"\"invalid token order\"",			true} },
+		{ ErrorType::ER_UNEXPECTED_TOKEN,			{100,	"\"unexpected token found\"",		false} },
+		{ ErrorType::ER_UNRECOGNIZED_CHAR,			{101,	"\"unrecognized character found\"",	false} },
+		{ ErrorType::ER_UNRECOGNIZED_NUM,			{102,	"\"unrecognized numerical found\"",	false} },
+		{ ErrorType::ER_INVALID_TOKEN_ORDER,		{103,	"\"invalid token order\"",			false} },
 
 		{ ErrorType::ER_LOADING_FILE,				{200,	"\"unable to load file\"",			true} },
+		{ ErrorType::ER_LOADING_INCLUDE,			{201,	"\"unable to load included file\"",	false} },
+		{ ErrorType::ER_INVALID_OBJECT,				{202,	"\"invalid object file\"",			true} },
 
-		{ ErrorType::ER_MULTIPLY_DEFINED_LABELS,	{301,	"\"multiply defined labels\"",		true} },
-		{ ErrorType::ER_INVALID_OPERAND,			{302,	"\"invalid operand type\"",			true} },
-		{ ErrorType::ER_UNRECOGNIZED_OPERATION,		{303,	"\"unrecognized operation found\"",	true} }
+		{ ErrorType::ER_MULTIPLY_DEFINED_LABELS,	{301,	"\"multiply defined labels\"",		false} },
+		{ ErrorType::ER_INVALID_OPERAND,			{302,	"\"invalid operand type\"",			false} },
+		{ ErrorType::ER_UNRECOGNIZED_OPERATION,		{303,	"\"unrecognized operation found\"",	false} },
+		{ ErrorType::ER_CROSS_CHECK_MISMATCH,		{304,	"\"one pass and two pass images differ\"",	false} },
+		{ ErrorType::ER_INCLUDE_NOT_DEFINITIONS,	{305,	"\"included file holds more than definitions\"",	false} },
+		{ ErrorType::ER_UNDEFINED_SYMBOL,			{306,	"\"undefined symbol\"",				false} },
+		{ ErrorType::ER_AMBIGUOUS_SYMBOL,			{307,	"\"symbol defined by several modules\"",	false} }
 	};
 
+	// reports a process level error, fatal ones terminate. errors of an assembly job
+	// go to the job's utils::Diagnostics instead
 	struct Error
 	{
 		ErrorType type;
@@ -59,13 +76,21 @@ namespace utils
 		{
 			if (fatal)
 			{
-				std::cout << "Error  E" << ErrorInfoMap[type].errorCode << "  " << ErrorInfoMap[type].errorMessage << "  ( line : " << line << " )\n";
+				std::cout << "Error  E" << ErrorInfoMap.at(type).errorCode << "  " << ErrorInfoMap.at(type).errorMessage << "  ( line : " << line << " )\n";
 				//exit(ErrorInfoMap[type].errorCode);
 				exit(-1);
 			}
 		}
 
-		Error(ErrorType _type, int _line) : Error(_type, ErrorInfoMap[_type].fatal, _line)
+		Error(ErrorType _type, int _line) : Error(_type, ErrorInfoMap.at(_type).fatal, _line)
 		{ }
 	};
+
+	// parse a hex string such as "00FF", invalid digits yield 0
+	int parseHex(std::string_view string)
+	{
+		int value = 0;
+		std::from_chars(string.data(), string.data() + string.size(), value, 16);
+		return value;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// replaces the whole family of allocation functions of the executable linking this file,
+// so every new pairs with the delete below, aligned and nothrow ones included. a
+// translation unit of its own keeps the free behind a delete out of the callers
+
+// defined by the executable, called for every allocation
+void countAllocation(size_t size);
+
+namespace
+{
+	void* allocate(size_t size)
+	{
+		countAllocation(size);
+		return std::malloc(size ? size : 1);
+	}
+
+	void* allocate(size_t size, std::align_val_t alignment)
+	{
+		countAllocation(size);
+		size_t align = static_cast<size_t>(alignment);
+#ifdef _WIN32
+		return _aligned_malloc(size ? size : 1, align);
+#else
+		// a multiple of the alignment, as aligned_alloc wants it, and never zero
+		return std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+#endif
+	}
+
+	void* allocateOrThrow(size_t size)
+	{
+		void* memory = allocate(size);
+		if (memory == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+
+	void* allocateOrThrow(size_t size, std::align_val_t alignment)
+	{
+		void* memory = allocate(size, alignment);
+		if (memory == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+
+	void deallocate(void* memory)
+	{
+		std::free(memory);
+	}
+
+	void deallocateAligned(void* memory)
+	{
+#ifdef _WIN32
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
+}
+
+void* operator new(size_t size)
+{
+	return allocateOrThrow(size);
+}
+
+void* operator new[](size_t size)
+{
+	return allocateOrThrow(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	return allocateOrThrow(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return allocateOrThrow(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return allocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return allocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept
+{
+	deallocate(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	deallocate(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	deallocate(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	deallocate(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	deallocate(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	deallocate(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+	deallocateAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+	deallocateAligned(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+	deallocateAligned(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept
+{
+	deallocateAligned(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	deallocateAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	deallocateAligned(memory);
+}
@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "assembler.h"
+#include "tokenizer.h"
+#include "diagnostics.h"
+#include "generator.h"
+#include "config.h"
+
+// every allocation of the process, reported by the operators in allocation.cpp. the
+// phases read the difference
+std::atomic<uint64_t> allocationCount(0);
+
+void countAllocation(size_t)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+struct Input
+{
+	std::string name;
+	std::string source;
+	size_t lines = 0;
+	size_t instructions = 0;
+};
+
+struct Result
+{
+	std::string input;
+	std::string phase;
+	size_t bytes;
+	size_t lines;
+	size_t instructions;
+	size_t iterations;
+	// fastest iteration
+	double seconds;
+	double allocationsPerLine;
+};
+
+bool loadInput(const std::string& path, const std::string& name, std::vector<Input>& inputs)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	inputs.push_back({ name, contents.str() });
+	return true;
+}
+
+// runs body until minimumTime has passed and at least three times, keeps the fastest
+Result measure(const Input& input, const std::string& phase, double minimumTime, const std::function<void()>& body)
+{
+	Result result = { input.name, phase, input.source.size(), input.lines, input.instructions, 0, 1e300, 0 };
+	double total = 0;
+
+	while (result.iterations < 3 || total < minimumTime)
+	{
+		uint64_t allocations = allocationCount;
+		auto start = std::chrono::steady_clock::now();
+
+		body();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		allocations = allocationCount - allocations;
+
+		result.seconds = std::min(result.seconds, seconds);
+		result.allocationsPerLine = static_cast<double>(allocations) / std::max<size_t>(1, input.lines);
+		result.iterations++;
+		total += seconds;
+	}
+
+	return result;
+}
+
+void benchmarkInput(Input& input, double minimumTime, std::vector<Result>& results)
+{
+	utils::Diagnostics diagnostics;
+	tokenizer::TokenStream tokens;
+	assembler::Intermediate intermediate;
+
+	// shared inputs of the later phases, built once outside the timed region
+	tokenizer::tokenize(input.source, tokens, diagnostics);
+	assembler::firstPass(tokens, intermediate, diagnostics);
+	if (diagnostics.hasErrors())
+	{
+		std::cerr << input.name << " :\n" << diagnostics;
+		return;
+	}
+	input.lines = std::count(input.source.begin(), input.source.end(), '\n') + 1;
+	input.instructions = intermediate.records.size();
+
+	results.push_back(measure(input, "tokenize", minimumTime, [&]()
+	{
+		tokenizer::TokenStream phaseTokens;
+		tokenizer::tokenize(input.source, phaseTokens, diagnostics);
+	}));
+
+	results.push_back(measure(input, "firstPass", minimumTime, [&]()
+	{
+		assembler::Intermediate phaseIntermediate;
+		assembler::firstPass(tokens, phaseIntermediate, diagnostics);
+	}));
+
+	results.push_back(measure(input, "secondPass", minimumTime, [&]()
+	{
+		std::vector<unsigned char> output;
+		assembler::secondPass(intermediate, output, diagnostics);
+	}));
+
+	results.push_back(measure(input, "assemble", minimumTime, [&]()
+	{
+		std::vector<unsigned char> output;
+		assembler::assembleSource(input.source, output, diagnostics);
+	}));
+
+	// a long running job loop : the workspace, its arena and the image are recycled,
+	// the steady state makes no heap allocations
+	assembler::Workspace workspace;
+	std::vector<unsigned char> output;
+	results.push_back(measure(input, "recycled", minimumTime, [&]()
+	{
+		output.clear();
+		assembler::assembleSource(input.source, output, diagnostics, workspace);
+	}));
+}
+
+// slots a lookup of every label visits on average, the distance of its slot from the one
+// its hash points at plus one
+double averageProbes(const assembler::SymbolTable& symbolTable)
+{
+	size_t mask = symbolTable.slots.size() - 1;
+	size_t probes = 0;
+
+	for (size_t i = 0; i < symbolTable.slots.size(); i++)
+	{
+		const assembler::SymbolTable::Slot& slot = symbolTable.slots[i];
+		if (slot.index != assembler::SymbolTable::EMPTY_SLOT)
+		{
+			probes += ((i - slot.hash) & mask) + 1;
+		}
+	}
+	return static_cast<double>(probes) / std::max<size_t>(1, symbolTable.size());
+}
+
+// symbol table scaling : half the lines define a label and every operand names one,
+// the time per instruction stays flat while define and find are constant time. returns
+// the average probes per lookup
+double benchmarkLabels(Input& input, double minimumTime, std::vector<Result>& results)
+{
+	utils::Diagnostics diagnostics;
+	tokenizer::TokenStream tokens;
+	assembler::Intermediate intermediate;
+
+	tokenizer::tokenize(input.source, tokens, diagnostics);
+	assembler::firstPass(tokens, intermediate, diagnostics);
+	if (diagnostics.hasErrors())
+	{
+		std::cerr << input.name << " :\n" << diagnostics;
+		return 0;
+	}
+	input.lines = std::count(input.source.begin(), input.source.end(), '\n') + 1;
+	input.instructions = intermediate.records.size();
+
+	// defines every label
+	results.push_back(measure(input, "firstPass", minimumTime, [&]()
+	{
+		assembler::Intermediate phaseIntermediate;
+		assembler::firstPass(tokens, phaseIntermediate, diagnostics);
+	}));
+
+	// looks one up per operand
+	results.push_back(measure(input, "secondPass", minimumTime, [&]()
+	{
+		std::vector<unsigned char> output;
+		assembler::secondPass(intermediate, output, diagnostics);
+	}));
+
+	return averageProbes(intermediate.symbolTable);
+}
+
+// fails if the time per instruction of a phase grows more than maximumRatio times from
+// the smallest label input to a larger one, or a lookup probes more than maximumProbes
+// slots on average. a define or find that is not constant time grows the time per
+// instruction with the label count, tenfold per tenfold more labels if it is linear
+bool checkScaling(const std::vector<Result>& results, const std::vector<double>& probes, double maximumRatio, double maximumProbes)
+{
+	bool passed = !probes.empty();
+
+	for (double average : probes)
+	{
+		if (average > maximumProbes)
+		{
+			std::cerr << "scaling : " << average << " probes per lookup, at most " << maximumProbes << " allowed\n";
+			passed = false;
+		}
+	}
+
+	for (auto& smallest : results)
+	{
+		for (auto& result : results)
+		{
+			if (result.phase != smallest.phase || result.instructions <= smallest.instructions)
+			{
+				continue;
+			}
+			double ratio = (result.seconds / result.instructions) / (smallest.seconds / smallest.instructions);
+			if (ratio > maximumRatio)
+			{
+				std::cerr << "scaling : " << result.phase << " of " << result.input << " takes " << ratio << " times the time per instruction of "
+					<< smallest.input << ", at most " << maximumRatio << " allowed\n";
+				passed = false;
+			}
+		}
+	}
+	return passed;
+}
+
+// every scan kernel of every table the cpu runs, on buffers of runs that end in a
+// character of no class. run lengths are drawn from [1, 2 * length) so branches cannot
+// learn them. lines and instructions count runs, the table shows runs per second and
+// ns per run
+void benchmarkKernels(const std::vector<size_t>& runLengths, double minimumTime, std::vector<Result>& results)
+{
+	const size_t BUFFER_SIZE = 1 << 24;
+
+	std::vector<const tokenizer::ScanKernels*> tables = { &tokenizer::ScalarKernels };
+#ifdef CHARCLASS_X86
+	tables.push_back(&tokenizer::Sse2Kernels);
+	if (tokenizer::cpuSupportsAvx2())
+	{
+		tables.push_back(&tokenizer::Avx2Kernels);
+	}
+#endif
+	if (std::find(tables.begin(), tables.end(), &tokenizer::scanKernels()) == tables.end())
+	{
+		tables.push_back(&tokenizer::scanKernels());
+	}
+
+	struct Kernel
+	{
+		const char* name;
+		std::string alphabet;
+		size_t(*tokenizer::ScanKernels::* scan)(const char*, size_t);
+	};
+	const Kernel kernels[] =
+	{
+		{ "ws", " \t", &tokenizer::ScanKernels::skipWhitespace },
+		{ "ident", "abcxyzABCXYZ0189_-.", &tokenizer::ScanKernels::scanIdentifier },
+		{ "hex", "0123456789abcdefABCDEF", &tokenizer::ScanKernels::scanHex }
+	};
+
+	volatile size_t sink = 0;
+	for (auto& kernel : kernels)
+	{
+		for (size_t length : runLengths)
+		{
+			generator::Random random = { length };
+			Input input;
+			input.name = std::string(kernel.name) + "-runs-" + std::to_string(length);
+			input.source.reserve(BUFFER_SIZE + 2 * length);
+			while (input.source.size() < BUFFER_SIZE)
+			{
+				size_t run = 1 + random.below(2 * length - 1);
+				for (size_t i = 0; i < run; i++)
+				{
+					input.source += kernel.alphabet[random.below(kernel.alphabet.size())];
+				}
+				input.source += ',';
+				input.lines++;
+			}
+			input.instructions = input.lines;
+
+			for (auto table : tables)
+			{
+				auto scan = table->*kernel.scan;
+				results.push_back(measure(input, table->name, minimumTime, [&]()
+				{
+					const char* data = input.source.data();
+					size_t size = input.source.size();
+					size_t scanned = 0;
+					for (size_t i = 0; i < size;)
+					{
+						size_t run = scan(data + i, size - i);
+						scanned += run;
+						i += run + 1;
+					}
+					sink = sink + scanned;
+				}));
+			}
+		}
+	}
+}
+
+void printTable(const std::vector<Result>& results)
+{
+	std::cout << std::left << std::setw(20) << "input" << std::setw(12) << "phase"
+		<< std::right << std::setw(14) << "lines/s" << std::setw(14) << "MB/s" << std::setw(12) << "ns/ins" << std::setw(12) << "allocs/line" << '\n';
+
+	for (auto& result : results)
+	{
+		std::cout << std::left << std::setw(20) << result.input << std::setw(12) << result.phase << std::right << std::fixed
+			<< std::setw(14) << std::setprecision(0) << result.lines / result.seconds
+			<< std::setw(14) << std::setprecision(1) << result.bytes / result.seconds / 1e6
+			<< std::setw(12) << std::setprecision(2) << result.seconds * 1e9 / std::max<size_t>(1, result.instructions)
+			<< std::setw(12) << std::setprecision(3) << result.allocationsPerLine << '\n';
+	}
+}
+
+bool writeJson(const std::vector<Result>& results, const std::string& path)
+{
+	std::ofstream json(path);
+
+	json << "{\n  \"version\": \"" << ASSEMBLER_VERSION << "\",\n  \"kernels\": \"" << tokenizer::scanKernels().name << "\",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& result = results[i];
+
+		json << std::setprecision(9)
+			<< "    { \"input\": \"" << result.input << "\", \"phase\": \"" << result.phase << "\""
+			<< ", \"bytes\": " << result.bytes << ", \"lines\": " << result.lines << ", \"instructions\": " << result.instructions
+			<< ", \"iterations\": " << result.iterations << ", \"seconds\": " << result.seconds
+			<< ", \"linesPerSecond\": " << result.lines / result.seconds
+			<< ", \"bytesPerSecond\": " << result.bytes / result.seconds
+			<< ", \"nsPerInstruction\": " << result.seconds * 1e9 / std::max<size_t>(1, result.instructions)
+			<< ", \"allocationsPerLine\": " << result.allocationsPerLine << " }"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	json << "  ]\n}\n";
+
+	return json.good();
+}
+
+int main(int argc, char* argv[])
+{
+	std::string resourceDirectory = BENCH_RES_DIR;
+	std::string jsonPath;
+	double minimumTime = 0.5;
+	std::vector<size_t> generatedLines = { 10000, 100000, 1000000 };
+	bool defaultSizes = true;
+	std::vector<size_t> generatedLabels = { 10000, 100000, 1000000 };
+	bool defaultLabels = true;
+	bool kernels = false;
+	double scalingRatio = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--json" && i + 1 < argc)
+		{
+			jsonPath = argv[++i];
+			continue;
+		}
+		if (argument == "--res" && i + 1 < argc)
+		{
+			resourceDirectory = argv[++i];
+			continue;
+		}
+		if (argument == "--min-time" && i + 1 < argc)
+		{
+			minimumTime = std::stod(argv[++i]);
+			continue;
+		}
+		if (argument == "--lines" && i + 1 < argc)
+		{
+			// replaces the default sizes, may be given several times
+			if (defaultSizes)
+			{
+				generatedLines.clear();
+				defaultSizes = false;
+			}
+			generatedLines.push_back(std::stoull(argv[++i]));
+			continue;
+		}
+		if (argument == "--labels" && i + 1 < argc)
+		{
+			// replaces the default label counts, 0 leaves the scaling inputs out
+			if (defaultLabels)
+			{
+				generatedLabels.clear();
+				defaultLabels = false;
+			}
+			size_t labels = std::stoull(argv[++i]);
+			if (labels != 0)
+			{
+				generatedLabels.push_back(labels);
+			}
+			continue;
+		}
+		if (argument == "--kernels")
+		{
+			// only the scan kernels
+			kernels = true;
+			continue;
+		}
+		if (argument == "--check-scaling" && i + 1 < argc)
+		{
+			// only the label inputs, fails if a phase scales worse than the ratio
+			scalingRatio = std::stod(argv[++i]);
+			continue;
+		}
+		std::cerr << "usage : assembler_bench [--json PATH] [--res DIR] [--min-time SECONDS] [--lines N]... [--labels N]... [--kernels] [--check-scaling RATIO]\n";
+		return 1;
+	}
+
+	if (kernels)
+	{
+		// from runs as short as the mnemonics, labels and operands of real sources up
+		// to long ones
+		std::vector<Result> results;
+		benchmarkKernels({ 4, 8, 16, 32, 64 }, minimumTime, results);
+
+		std::cout << "dispatched : " << tokenizer::scanKernels().name << "\n\n";
+		printTable(results);
+
+		if (!jsonPath.empty() && !writeJson(results, jsonPath))
+		{
+			std::cerr << "unable to write " << jsonPath << '\n';
+			return 1;
+		}
+		return 0;
+	}
+
+	std::vector<Input> inputs;
+	for (auto name : { "mult.asm", "inc+dec.asm" })
+	{
+		if (scalingRatio == 0 && !loadInput(resourceDirectory + name, name, inputs))
+		{
+			std::cerr << "unable to load " << resourceDirectory + name << '\n';
+			return 1;
+		}
+	}
+	if (scalingRatio != 0)
+	{
+		generatedLines.clear();
+	}
+	for (size_t lines : generatedLines)
+	{
+		// one label every four lines and a few definitions, references go both ways
+		generator::Profile profile;
+		profile.lines = lines;
+		profile.labels = lines / 4;
+		profile.definitions = lines / 100;
+
+		Input input;
+		input.name = "generated-" + std::to_string(lines);
+		generator::generate(profile, input.source);
+		inputs.push_back(std::move(input));
+	}
+	std::vector<Input> labelInputs;
+	for (size_t labels : generatedLabels)
+	{
+		// a label every other line, every operand of an address instruction names one
+		generator::Profile profile;
+		profile.lines = labels * 2;
+		profile.labels = labels;
+		profile.definitions = 0;
+		profile.rawOperands = 0;
+
+		Input input;
+		input.name = "labels-" + std::to_string(labels);
+		generator::generate(profile, input.source);
+		labelInputs.push_back(std::move(input));
+	}
+
+#ifndef NDEBUG
+	std::cerr << "warning : built without NDEBUG, configure with -DCMAKE_BUILD_TYPE=Release for representative numbers\n";
+#endif
+
+	std::vector<Result> results;
+	for (auto& input : inputs)
+	{
+		benchmarkInput(input, minimumTime, results);
+	}
+	std::vector<Result> labelResults;
+	std::vector<double> probes;
+	for (auto& input : labelInputs)
+	{
+		probes.push_back(benchmarkLabels(input, minimumTime, labelResults));
+	}
+	results.insert(results.end(), labelResults.begin(), labelResults.end());
+
+	printTable(results);
+
+	if (!jsonPath.empty() && !writeJson(results, jsonPath))
+	{
+		std::cerr << "unable to write " << jsonPath << '\n';
+		return 1;
+	}
+
+	// linear probing at a load factor of at most one half averages 1.5 probes
+	if (scalingRatio != 0 && !checkScaling(labelResults, probes, scalingRatio, 2.5))
+	{
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "emulator.h"
+#include "sourcebuffer.h"
+#include "threadpool.h"
+
+
+struct RunResult
+{
+	bool loaded = false;
+	emulator::Status status = emulator::Status::ST_HALTED;
+	uint64_t executed = 0;
+	std::vector<unsigned char> printed;
+	uint64_t printCount = 0;
+};
+
+bool runImage(const std::string& path, emulator::Machine& machine, uint64_t budget, RunResult& result)
+{
+	utils::SourceBuffer image;
+	if (!image.map(path))
+	{
+		return false;
+	}
+
+	machine.load(reinterpret_cast<const unsigned char*>(image.data), image.size);
+	result.loaded = true;
+	result.status = emulator::run(machine, budget);
+	result.executed = machine.executed;
+	result.printed = machine.printed;
+	result.printCount = machine.printCount;
+	return true;
+}
+
+void printValues(std::ostream& os, const std::vector<unsigned char>& values, char separator)
+{
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		os << static_cast<int>(values[i]) << (i + 1 < values.size() ? separator : '\n');
+	}
+}
+
+int exitCode(emulator::Status status)
+{
+	switch (status)
+	{
+	case emulator::Status::ST_HALTED:
+		return 0;
+	case emulator::Status::ST_BUDGET_EXHAUSTED:
+		return 2;
+	default:
+		return 3;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t budget = 1000000000;
+	bool batch = false;
+	size_t threadCount = 0;
+	std::vector<std::string> images;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--budget" && i + 1 < argc)
+		{
+			budget = std::stoull(argv[++i]);
+			continue;
+		}
+		if (argument == "--batch")
+		{
+			batch = true;
+			continue;
+		}
+		if (argument == "-j" && i + 1 < argc)
+		{
+			threadCount = std::stoul(argv[++i]);
+			continue;
+		}
+		images.push_back(argument);
+	}
+
+	if (images.empty())
+	{
+		std::cerr << "usage : assembler_emulator [--budget N] [--batch] [-j N] image...\n";
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (!batch)
+	{
+		// values printed by PRT go to stdout, one per line
+		emulator::Machine machine;
+		RunResult result;
+
+		if (!runImage(images.back(), machine, budget, result))
+		{
+			std::cerr << "unable to load " << images.back() << '\n';
+			return 1;
+		}
+		printValues(std::cout, result.printed, '\n');
+		if (result.printCount > result.printed.size())
+		{
+			std::cerr << result.printCount - result.printed.size() << " more values printed\n";
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << emulator::statusName(result.status) << " after " << result.executed << " instructions, pc " << machine.pc
+			<< "  ( " << result.executed / seconds / 1e6 << " M instructions/s )\n";
+
+		return exitCode(result.status);
+	}
+
+	std::vector<RunResult> results(images.size());
+	{
+		utils::ThreadPool pool(threadCount);
+		// one machine per worker, reloaded for every image
+		std::vector<emulator::Machine> machines(pool.size());
+
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			pool.submit([&, i]()
+			{
+				runImage(images[i], machines[utils::ThreadPool::currentWorker()], budget, results[i]);
+			});
+		}
+		pool.wait();
+	}
+
+	uint64_t executed = 0;
+	size_t halted = 0;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const RunResult& result = results[i];
+		if (!result.loaded)
+		{
+			std::cout << "unloadable        " << images[i] << '\n';
+			continue;
+		}
+
+		std::cout << std::left;
+		std::cout.width(18);
+		std::cout << emulator::statusName(result.status) << images[i] << "  ( " << result.executed << " instructions )  ";
+		printValues(std::cout, result.printed, ' ');
+		if (result.printed.empty())
+		{
+			std::cout << '\n';
+		}
+
+		executed += result.executed;
+		halted += result.status == emulator::Status::ST_HALTED;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << halted << " of " << images.size() << " images halted, " << executed << " instructions  ( "
+		<< executed / seconds / 1e6 << " M instructions/s )\n";
+
+	return halted == images.size() ? 0 : 1;
+}
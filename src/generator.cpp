@@ -0,0 +1,135 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "generator.h"
+#include "passes.h"
+
+
+// NAME=WEIGHT for one mnemonic
+bool parseWeight(const std::string& argument, generator::Profile& profile)
+{
+	size_t equal = argument.find('=');
+	if (equal == std::string::npos)
+	{
+		return false;
+	}
+
+	const assembler::Operation* operation = assembler::findOperation(std::string_view(argument).substr(0, equal));
+	if (operation == nullptr)
+	{
+		return false;
+	}
+
+	profile.mnemonicWeights[operation - assembler::OperationTable] = std::stod(argument.substr(equal + 1));
+	return true;
+}
+
+int usage()
+{
+	std::cerr << "usage : assembler_generator [-o PATH] [--seed N] [--lines N] [--definitions N] [--labels N]\n"
+		"                           [--literal-definitions RATIO] [--forward RATIO] [--raw WEIGHT] [--symbol WEIGHT]\n"
+		"                           [--name-length N] [--mnemonic NAME=WEIGHT]...\n"
+		"definitions and labels default to 1% and 10% of the lines\n";
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	generator::Profile profile;
+	std::string outputPath;
+	bool definitionsGiven = false;
+	bool labelsGiven = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (i + 1 >= argc)
+		{
+			return usage();
+		}
+		std::string value = argv[++i];
+
+		if (argument == "-o")
+		{
+			outputPath = value;
+		}
+		else if (argument == "--seed")
+		{
+			profile.seed = std::stoull(value);
+		}
+		else if (argument == "--lines")
+		{
+			profile.lines = std::stoull(value);
+		}
+		else if (argument == "--definitions")
+		{
+			profile.definitions = std::stoull(value);
+			definitionsGiven = true;
+		}
+		else if (argument == "--labels")
+		{
+			profile.labels = std::stoull(value);
+			labelsGiven = true;
+		}
+		else if (argument == "--literal-definitions")
+		{
+			profile.literalDefinitions = std::stod(value);
+		}
+		else if (argument == "--forward")
+		{
+			profile.forwardReferences = std::stod(value);
+		}
+		else if (argument == "--raw")
+		{
+			profile.rawOperands = std::stod(value);
+		}
+		else if (argument == "--symbol")
+		{
+			profile.symbolOperands = std::stod(value);
+		}
+		else if (argument == "--name-length")
+		{
+			profile.nameLength = std::stoull(value);
+		}
+		else if (argument == "--mnemonic")
+		{
+			if (!parseWeight(value, profile))
+			{
+				return usage();
+			}
+		}
+		else
+		{
+			return usage();
+		}
+	}
+
+	// the defaults of the profile fit its 10000 lines, scaled they fit any count
+	if (!definitionsGiven)
+	{
+		profile.definitions = profile.lines / 100;
+	}
+	if (!labelsGiven)
+	{
+		profile.labels = profile.lines / 10;
+	}
+
+	std::string source;
+	if (!generator::generate(profile, source))
+	{
+		std::cerr << "definitions and labels exceed the line count, or no mnemonic has a weight\n";
+		return 1;
+	}
+
+	if (outputPath.empty())
+	{
+		std::cout.write(source.data(), source.size());
+		return std::cout.good() ? 0 : 1;
+	}
+
+	std::ofstream output(outputPath, std::ios::binary);
+	output.write(source.data(), source.size());
+	return output.good() ? 0 : 1;
+}
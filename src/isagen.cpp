@@ -0,0 +1,178 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "isahash.h"
+
+// turns an instruction set definition into constexpr lookup tables
+
+struct Instruction
+{
+	std::string mnemonic;
+	unsigned int opcode;
+	unsigned int wordSize;
+	std::string operand;
+	unsigned int cycles;
+};
+
+bool readDefinition(const std::string& path, std::vector<Instruction>& instructions)
+{
+	std::ifstream definition(path);
+	if (!definition.is_open())
+	{
+		std::cerr << "isagen : unable to open " << path << '\n';
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(definition, line))
+	{
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+		{
+			line.erase(comment);
+		}
+
+		std::istringstream fields(line);
+		Instruction instruction;
+		std::string opcode;
+		if (!(fields >> instruction.mnemonic))
+		{
+			continue;
+		}
+		if (!(fields >> opcode >> instruction.wordSize >> instruction.operand >> instruction.cycles))
+		{
+			std::cerr << path << '(' << lineNumber << ") : expected mnemonic, opcode, word size, operand and cycles\n";
+			return false;
+		}
+		instruction.opcode = std::stoul(opcode, nullptr, 16);
+
+		if (instruction.opcode > 0xFF || instruction.wordSize < 1 || instruction.wordSize > 3 || instruction.cycles < 1 ||
+			(instruction.operand != "none" && instruction.operand != "address" && instruction.operand != "literal"))
+		{
+			std::cerr << path << '(' << lineNumber << ") : invalid instruction " << instruction.mnemonic << '\n';
+			return false;
+		}
+		for (auto& other : instructions)
+		{
+			if (other.mnemonic == instruction.mnemonic || other.opcode == instruction.opcode)
+			{
+				std::cerr << path << '(' << lineNumber << ") : " << instruction.mnemonic << " clashes with " << other.mnemonic << '\n';
+				return false;
+			}
+		}
+		instructions.push_back(instruction);
+	}
+	return true;
+}
+
+// smallest power of two table with a seed that sends every mnemonic to its own slot
+bool findPerfectHash(const std::vector<Instruction>& instructions, uint32_t& seed, uint32_t& size, std::vector<int>& slots)
+{
+	for (size = 1; size < instructions.size(); size <<= 1);
+
+	for (; size <= 1024; size <<= 1)
+	{
+		for (seed = 0; seed < 100000; seed++)
+		{
+			slots.assign(size, -1);
+
+			bool collision = false;
+			for (size_t i = 0; i < instructions.size() && !collision; i++)
+			{
+				uint32_t slot = isa::mnemonicHash(instructions[i].mnemonic, seed) & (size - 1);
+				collision = slots[slot] != -1;
+				slots[slot] = static_cast<int>(i);
+			}
+			if (!collision)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3)
+	{
+		std::cerr << "usage : isagen <definition> <header>\n";
+		return 1;
+	}
+
+	std::vector<Instruction> instructions;
+	if (!readDefinition(argv[1], instructions))
+	{
+		return 1;
+	}
+
+	uint32_t seed;
+	uint32_t size;
+	std::vector<int> slots;
+	if (!findPerfectHash(instructions, seed, size, slots))
+	{
+		std::cerr << "isagen : no perfect hash found\n";
+		return 1;
+	}
+
+	std::vector<int> decode(256, -1);
+	for (size_t i = 0; i < instructions.size(); i++)
+	{
+		decode[instructions[i].opcode] = static_cast<int>(i);
+	}
+
+	std::ostringstream header;
+	header << "#pragma once\n\n";
+	header << "// generated by isagen from " << argv[1] << ", do not edit\n\n";
+	header << "namespace assembler\n{\n";
+
+	header << "\tconstexpr Operation OperationTable[] =\n\t{\n";
+	for (auto& instruction : instructions)
+	{
+		char opcode[8];
+		snprintf(opcode, sizeof(opcode), "0x%02X", instruction.opcode);
+		std::string operand = instruction.operand == "address" ? "OT_ADDRESS" : instruction.operand == "literal" ? "OT_LITERAL" : "OT_NONE";
+		header << "\t\t{ \"" << instruction.mnemonic << "\", " << opcode << ", " << instruction.wordSize << ", OperandType::" << operand << ", " << instruction.cycles << " },\n";
+	}
+	header << "\t};\n\n";
+
+	header << "\tconstexpr size_t OperationCount = " << instructions.size() << ";\n\n";
+
+	header << "\t// perfect hash of the mnemonics : isa::mnemonicHash(mnemonic, MnemonicHashSeed) & (MnemonicHashSize - 1)\n";
+	header << "\tconstexpr uint32_t MnemonicHashSeed = " << seed << ";\n";
+	header << "\tconstexpr uint32_t MnemonicHashSize = " << size << ";\n";
+	header << "\tconstexpr int16_t MnemonicHashTable[MnemonicHashSize] =\n\t{";
+	for (uint32_t i = 0; i < size; i++)
+	{
+		header << (i % 16 == 0 ? "\n\t\t" : " ") << slots[i] << ',';
+	}
+	header << "\n\t};\n\n";
+
+	header << "\t// opcode to OperationTable index, -1 for unused opcodes\n";
+	header << "\tconstexpr int16_t OpcodeDecodeTable[256] =\n\t{";
+	for (int i = 0; i < 256; i++)
+	{
+		header << (i % 16 == 0 ? "\n\t\t" : " ") << decode[i] << ',';
+	}
+	header << "\n\t};\n}\n";
+
+	// leave the file alone when nothing changed, so dependents do not rebuild
+	std::ifstream existing(argv[2]);
+	std::stringstream current;
+	current << existing.rdbuf();
+	if (existing.is_open() && current.str() == header.str())
+	{
+		return 0;
+	}
+	existing.close();
+
+	std::ofstream output(argv[2]);
+	output << header.str();
+	return output.good() ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "linker.h"
+#include "passes.h"
+#include "stats.h"
+
+
+int main(int argc, char* argv[])
+{
+	std::string outputPath = assembler::OBJECT_PATH;
+	emitter::Format format = emitter::Format::OF_RAW;
+	bool map = false;
+	bool statistics = false;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "-o" && i + 1 < argc)
+		{
+			outputPath = argv[++i];
+			continue;
+		}
+		if (argument == "--format" && i + 1 < argc)
+		{
+			if (!emitter::parseFormat(argv[++i], format))
+			{
+				std::cerr << "unknown format " << argv[i] << ", expected raw, hex or c\n";
+				return 1;
+			}
+			continue;
+		}
+		if (argument == "--map")
+		{
+			map = true;
+			continue;
+		}
+		if (argument == "--stats")
+		{
+			statistics = true;
+			stats::enable();
+			continue;
+		}
+		inputs.push_back(argument);
+	}
+
+	if (inputs.empty())
+	{
+		std::cerr << "usage : assembler_linker [-o image] [--format raw|hex|c] [--map] [--stats] object...\n";
+		return 1;
+	}
+
+	std::vector<linker::Module> modules(inputs.size());
+	std::vector<unsigned char> image;
+
+	bool linked = linker::load(inputs, modules) && linker::link(modules, image) && assembler::writeObject(image, outputPath, format);
+
+	for (auto& module : modules)
+	{
+		if (!module.diagnostics.entries.empty())
+		{
+			std::cout << module.path << '\n' << module.diagnostics;
+		}
+	}
+	if (linked)
+	{
+		std::cout << inputs.size() << " modules linked -> " << outputPath << "  ( " << image.size() << " bytes )\n";
+	}
+	if (linked && map)
+	{
+		linker::printMap(std::cout, modules);
+	}
+	if (statistics)
+	{
+		stats::printTable(std::cerr, stats::totals());
+	}
+
+	return linked ? 0 : 1;
+}
@@ -1,19 +1,429 @@
-
-
 #include <string>
 #include <vector>
+#include <filesystem>
 #include "assembler.h"
 #include "tokenizer.h"
+#include "cache.h"
+#include "threadpool.h"
+#include "server.h"
+#include "stats.h"
+#include "stream.h"
+#include "object.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+
+// every allocation of the process, reported by the operators in allocation.cpp. counted
+// for --stats, a flag test otherwise
+void countAllocation(size_t size)
+{
+	stats::countAllocation(size);
+}
+
+
+struct JobResult
+{
+	std::string outputPath;
+	size_t size = 0;
+	bool success = false;
+	utils::Diagnostics diagnostics;
+	assembler::OptimizationReport report;
+};
+
+// one input path per line, blank lines and lines starting with # are skipped
+bool readManifest(const std::string& path, std::vector<std::string>& inputs)
+{
+	std::ifstream manifest(path);
+	if (!manifest.is_open())
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(manifest, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		inputs.push_back(line);
+	}
+	return true;
+}
+
+int runBatch(const std::vector<std::string>& inputs, const assembler::Options& options, size_t threadCount, emitter::Format format)
+{
+	std::vector<JobResult> results(inputs.size());
+
+	{
+		utils::ThreadPool pool(threadCount);
 
+		for (size_t i = 0; i < inputs.size(); i++)
+		{
+			pool.submit([&, i]()
+			{
+				// every job gets its own options, image and output files
+				assembler::Options jobOptions = options;
+				jobOptions.dumpPrefix = inputs[i] + ".";
+				// jobs already fill the pool
+				jobOptions.threadPool = nullptr;
+
+				// every worker keeps its workspace and arena from job to job
+				thread_local assembler::Workspace workspace;
+				std::vector<unsigned char> image;
+				JobResult& result = results[i];
+
+				result.outputPath = std::filesystem::path(inputs[i]).replace_extension(emitter::extension(format)).string();
+				result.success = assembler::assembleFile(inputs[i], image, result.diagnostics, workspace, jobOptions) && assembler::writeObject(image, result.outputPath, format);
+				result.size = image.size();
+				result.report = workspace.optimization;
+			});
+		}
+		pool.wait();
+	}
+
+	size_t failed = 0;
+	assembler::OptimizationReport report;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		if (results[i].success)
+		{
+			std::cout << "ok      " << inputs[i] << " -> " << results[i].outputPath << "  ( " << results[i].size << " bytes )\n";
+			report.add(results[i].report);
+		}
+		else
+		{
+			std::cout << "failed  " << inputs[i] << '\n';
+			std::cout << results[i].diagnostics;
+			failed++;
+		}
+	}
+	std::cout << inputs.size() - failed << " of " << inputs.size() << " files assembled\n";
+	if (options.optimize)
+	{
+		std::cout << report;
+	}
+
+	return failed == 0 ? 0 : 1;
+}
 
-int main()
+// assembles every input into an object next to it, skipping the ones whose object is
+// newer than the source and its includes
+int runCompile(const std::vector<std::string>& inputs, const assembler::Options& options, size_t threadCount)
+{
+	std::vector<JobResult> results(inputs.size());
+	std::vector<char> current(inputs.size(), 0);
+
+	{
+		utils::ThreadPool pool(threadCount);
+
+		for (size_t i = 0; i < inputs.size(); i++)
+		{
+			pool.submit([&, i]()
+			{
+				JobResult& result = results[i];
+				result.outputPath = std::filesystem::path(inputs[i]).replace_extension(assembler::OBJECT_EXTENSION).string();
+
+				std::string depfilePath = std::filesystem::path(inputs[i]).replace_extension(assembler::DEPFILE_EXTENSION).string();
+				if (assembler::objectUpToDate(result.outputPath, depfilePath))
+				{
+					current[i] = 1;
+					result.success = true;
+					return;
+				}
+
+				assembler::Options jobOptions = options;
+				jobOptions.threadPool = nullptr;
+
+				thread_local assembler::Workspace workspace;
+				assembler::ObjectModule module;
+				result.success = assembler::compileFile(inputs[i], module, result.diagnostics, workspace, jobOptions);
+				result.size = module.code.size();
+			});
+		}
+		pool.wait();
+	}
+
+	size_t failed = 0;
+	size_t skipped = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		if (current[i])
+		{
+			std::cout << "current " << inputs[i] << " -> " << results[i].outputPath << '\n';
+			skipped++;
+		}
+		else if (results[i].success)
+		{
+			std::cout << "ok      " << inputs[i] << " -> " << results[i].outputPath << "  ( " << results[i].size << " bytes )\n";
+		}
+		else
+		{
+			std::cout << "failed  " << inputs[i] << '\n';
+			std::cout << results[i].diagnostics;
+			failed++;
+		}
+	}
+	std::cout << inputs.size() - failed - skipped << " of " << inputs.size() << " files assembled, " << skipped << " up to date\n";
+
+	return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
 {
 	std::vector<unsigned char> output;
+	assembler::Options options;
 
 	std::string filename = "mult.asm";
 	//std::string filename = "inc+dec.asm";
 
-	assembler::assemble(filename, output);
+	std::string cacheDirectory;
+	uint64_t cacheSize = 256;
+	bool cacheStatistics = false;
+	// table, or json
+	std::string statistics;
+
+	bool batch = false;
+	emitter::Format format = emitter::Format::OF_RAW;
+	// relocatable objects for the linker instead of images
+	bool compile = false;
+	// socket path, or - for stdin and stdout
+	std::string serverPath;
+	// largest source a server request may carry
+	size_t maxRequestSize = server::DEFAULT_MAX_SOURCE_SIZE;
+	// definitions file to precompile
+	std::string precompilePath;
+	bool parallel = false;
+	size_t threadCount = 0;
+	// bytes of source held at once when streaming from stdin
+	size_t window = 1 << 20;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--dump")
+		{
+			options.dumpIntermediate = true;
+			continue;
+		}
+		if (argument == "--cache" && i + 1 < argc)
+		{
+			cacheDirectory = argv[++i];
+			continue;
+		}
+		if (argument == "--cache-size" && i + 1 < argc)
+		{
+			// in MiB
+			cacheSize = std::stoull(argv[++i]);
+			continue;
+		}
+		if (argument == "--cache-stats")
+		{
+			cacheStatistics = true;
+			continue;
+		}
+		if (argument == "--stats" || argument == "--stats=json")
+		{
+			statistics = argument == "--stats" ? "table" : "json";
+			stats::enable();
+			continue;
+		}
+		if (argument == "--batch")
+		{
+			batch = true;
+			continue;
+		}
+		if (argument == "--format" && i + 1 < argc)
+		{
+			if (!emitter::parseFormat(argv[++i], format))
+			{
+				std::cerr << "unknown format " << argv[i] << ", expected raw, hex or c\n";
+				return 1;
+			}
+			continue;
+		}
+		if (argument == "-c")
+		{
+			compile = true;
+			continue;
+		}
+		if (argument == "--server" && i + 1 < argc)
+		{
+			serverPath = argv[++i];
+			continue;
+		}
+		if (argument == "--max-request" && i + 1 < argc)
+		{
+			// in MiB
+			maxRequestSize = std::stoull(argv[++i]) << 20;
+			continue;
+		}
+		if (argument == "--pch" && i + 1 < argc)
+		{
+			precompilePath = argv[++i];
+			continue;
+		}
+		if (argument == "--one-pass")
+		{
+			options.onePass = true;
+			continue;
+		}
+		if (argument == "--cross-check")
+		{
+			options.onePass = true;
+			options.crossCheck = true;
+			continue;
+		}
+		if (argument == "-O")
+		{
+			options.optimize = true;
+			continue;
+		}
+		if (argument == "--parallel")
+		{
+			parallel = true;
+			continue;
+		}
+		if (argument == "--window" && i + 1 < argc)
+		{
+			// in KiB
+			window = std::stoull(argv[++i]) << 10;
+			continue;
+		}
+		if (argument == "-j" && i + 1 < argc)
+		{
+			threadCount = std::stoul(argv[++i]);
+			continue;
+		}
+		if (argument[0] == '@')
+		{
+			if (!readManifest(argument.substr(1), inputs))
+			{
+				utils::Error(utils::ErrorType::ER_LOADING_FILE, 0);
+			}
+			continue;
+		}
+		inputs.push_back(argument);
+	}
+
+	// the optimizer rewrites the records of the two pass assembler, the one pass one
+	// has none and its image would not match an optimized one
+	if (options.optimize && options.onePass)
+	{
+		std::cerr << "-O cannot be combined with --one-pass or --cross-check\n";
+		return 1;
+	}
+
+	cache::Cache cache;
+	if (!cacheDirectory.empty())
+	{
+		if (!cache.open(cacheDirectory, cacheSize << 20))
+		{
+			utils::Error(utils::ErrorType::ER_LOADING_FILE, 0);
+		}
+		options.cache = &cache;
+	}
+
+	int status = 0;
+	if (!precompilePath.empty())
+	{
+		// writes PATH.pch next to the definitions file
+		std::string bytes;
+		utils::Diagnostics diagnostics;
+		status = assembler::precompileFile(precompilePath, bytes, diagnostics) ? 0 : 1;
+		std::cout << diagnostics;
+	}
+	else if (serverPath == "-")
+	{
+		status = server::serveStdio(options, maxRequestSize);
+	}
+	else if (!serverPath.empty())
+	{
+#ifdef _WIN32
+		// no unix domain sockets here, only stdin and stdout
+		utils::Error(utils::ErrorType::ER_LOADING_FILE, 0);
+#else
+		status = server::serveSocket(serverPath, options, threadCount, maxRequestSize);
+#endif
+	}
+	else if (compile)
+	{
+		// plain paths as in batch mode
+		status = runCompile(inputs, options, threadCount);
+	}
+	else if (batch)
+	{
+		// batch inputs are plain paths, not relative to the resource directory
+		status = runBatch(inputs, options, threadCount, format);
+	}
+	else if (!inputs.empty() && inputs.back() == "-")
+	{
+		// source from stdin, image to stdout, diagnostics to stderr
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		std::ios::sync_with_stdio(false);
+
+		utils::Diagnostics diagnostics;
+		status = assembler::assembleStream(std::cin, std::cout, diagnostics, window) ? 0 : 1;
+		std::cerr << diagnostics;
+	}
+	else
+	{
+		if (!inputs.empty())
+		{
+			filename = inputs.back();
+		}
+
+		std::unique_ptr<utils::ThreadPool> pool;
+		if (parallel)
+		{
+			pool = std::make_unique<utils::ThreadPool>(threadCount);
+			options.threadPool = pool.get();
+		}
+
+		utils::Diagnostics diagnostics;
+		assembler::Workspace workspace;
+		if (assembler::assemble(filename, output, diagnostics, workspace, options))
+		{
+			std::string outputPath = utils::RES_PATH + std::filesystem::path(assembler::OBJECT_PATH).replace_extension(emitter::extension(format)).string();
+			assembler::writeObject(output, outputPath, format);
+		}
+		else
+		{
+			status = 1;
+		}
+		std::cout << diagnostics;
+		if (options.optimize && status == 0)
+		{
+			std::cout << workspace.optimization;
+		}
+	}
+
+	if (cacheStatistics && cache.isOpen())
+	{
+		std::cout << cache.totals();
+	}
+
+	// stdout may carry the server protocol
+	if (statistics == "table")
+	{
+		stats::printTable(std::cerr, stats::totals());
+	}
+	if (statistics == "json")
+	{
+		stats::printJson(std::cerr, stats::totals());
+	}
 
-	return 0;
+	return status;
 }
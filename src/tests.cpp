@@ -0,0 +1,126 @@
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "assembler.h"
+#include "tokenizer.h"
+#include "diagnostics.h"
+#include "threadpool.h"
+
+// behaviour the reference images of res/ do not pin down, run by ctest. every check
+// prints its name when it fails and the exit code counts the failures
+
+int failures = 0;
+
+void check(bool condition, const char* name)
+{
+	if (!condition)
+	{
+		std::cerr << "failed : " << name << '\n';
+		failures++;
+	}
+}
+
+// spaces and tabs end a symbol, the pieces are separate tokens and the line is out of
+// grammar. the original lexer joined them to one name
+void testWhitespaceEndsSymbol()
+{
+	utils::Diagnostics diagnostics;
+	tokenizer::TokenStream tokens;
+	std::string source = "my label:\n\tLDA, my label\n";
+
+	diagnostics.source = source;
+	tokenizer::tokenize(source, tokens, diagnostics);
+
+	check(tokens.lineCount() == 0, "whitespace : lines with a spaced symbol are dropped");
+	check(diagnostics.entries.size() == 2, "whitespace : one error per line");
+	for (auto& diagnostic : diagnostics.entries)
+	{
+		check(diagnostic.type == utils::ErrorType::ER_UNEXPECTED_TOKEN, "whitespace : the second piece is an unexpected token");
+	}
+	if (diagnostics.entries.size() == 2)
+	{
+		check(diagnostics.entries[0].column == 4 && diagnostics.entries[1].column == 10, "whitespace : errors point at the second piece");
+	}
+
+	// around punctuation whitespace only separates
+	std::vector<unsigned char> spaced;
+	std::vector<unsigned char> packed;
+	utils::Diagnostics spacedDiagnostics;
+	utils::Diagnostics packedDiagnostics;
+	check(assembler::assembleSource("one \t= \t$0050\nmy_label :\n\tLDA , one\n\tJMP ,\tmy_label\n", spaced, spacedDiagnostics), "whitespace : spaced punctuation assembles");
+	check(assembler::assembleSource("one=$0050\nmy_label:\n\tLDA,one\n\tJMP,my_label\n", packed, packedDiagnostics), "whitespace : packed punctuation assembles");
+	check(spaced == packed, "whitespace : spacing around punctuation leaves the image alone");
+}
+
+// a cache hit appends the image to output like a miss does
+void testCacheHitAppends()
+{
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / ("assembler_tests_cache" + std::to_string(std::random_device{}()));
+	std::string source = "one\t=\t$0050\nstart:\n\tLDI, %01\n\tSTA, one\n\tJMP, start\n";
+	// the hit starts from other bytes than the miss that stored the entry
+	const std::vector<unsigned char> prefix = { 0xAA, 0xBB };
+	const std::vector<unsigned char> hitPrefix = { 0xCC };
+
+	{
+		cache::Cache imageCache;
+		check(imageCache.open(directory.string(), 1 << 20), "cache : opens");
+
+		assembler::Options options;
+		options.cache = &imageCache;
+
+		std::vector<unsigned char> uncached = prefix;
+		std::vector<unsigned char> miss = prefix;
+		std::vector<unsigned char> hit = hitPrefix;
+		utils::Diagnostics diagnostics;
+
+		check(assembler::assembleSource(source, uncached, diagnostics), "cache : assembles without");
+		check(assembler::assembleSource(source, miss, diagnostics, options), "cache : assembles on a miss");
+		check(assembler::assembleSource(source, hit, diagnostics, options), "cache : assembles on a hit");
+
+		check(imageCache.statistics.misses == 1 && imageCache.statistics.hits == 1, "cache : one miss then one hit");
+		check(uncached.size() > prefix.size() && std::equal(prefix.begin(), prefix.end(), uncached.begin()), "cache : the image follows what output held");
+		check(miss == uncached, "cache : a miss gives the uncached output");
+		check(hit.size() == hitPrefix.size() + miss.size() - prefix.size() && hit[0] == hitPrefix[0] &&
+			std::equal(hit.begin() + hitPrefix.size(), hit.end(), miss.begin() + prefix.size()), "cache : a hit appends the image of a miss");
+	}
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+}
+
+// parallelFor from inside a task waits for its own batch only and runs queued tasks
+// meanwhile, even with every worker busy in an outer one
+void testNestedParallelFor()
+{
+	for (size_t threads : { 1, 2, 4 })
+	{
+		utils::ThreadPool pool(threads);
+		std::atomic<size_t> count{ 0 };
+
+		pool.parallelFor(8, [&](size_t)
+		{
+			pool.parallelFor(8, [&](size_t)
+			{
+				count++;
+			});
+		});
+
+		check(count == 64, "thread pool : nested parallelFor runs every inner task");
+	}
+}
+
+int main()
+{
+	testWhitespaceEndsSymbol();
+	testCacheHitAppends();
+	testNestedParallelFor();
+
+	if (failures == 0)
+	{
+		std::cout << "all tests passed\n";
+	}
+	return failures;
+}